@@ -9,6 +9,35 @@
 #include <cmath>
 #include <algorithm>
 #include <map>
+#include <list>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <coroutine>
+#include <utility>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstring>
+#include <string_view>
+#include <charconv>
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <functional>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>   // AVX2 / AVX-512 kernels are compiled per function and picked at run time
+#define SIMD_DISPATCH 1
+#endif
+#include "platform.h"
 
 using namespace std;
 
@@ -16,8 +45,93 @@ using namespace std;
 // SHARED DATA TYPES
 // ==========================================
 
-enum TokenType { LBRACKET, RBRACKET, COMMA, PLUS, MINUS, MULTIPLY, NUMBER, UNKNOWN, END_TOKEN, NONE_TOKEN };
-struct Token { TokenType type; string value; };
+enum TokenType { LBRACKET, RBRACKET, COMMA, PLUS, MINUS, MULTIPLY, LPAREN, RPAREN, NUMBER, UNKNOWN, END_TOKEN, NONE_TOKEN };
+struct Token { TokenType type; string value; int offset = 0; };
+
+// Why a run was rejected; every validator must agree on this, not just on accept/reject.
+enum ErrorKind { ERR_NONE, ERR_SYNTAX, ERR_TRAILING, ERR_1X1, ERR_ROW_MISMATCH, ERR_DIM_MISMATCH };
+const char* ErrorKindName(ErrorKind k) {
+    switch (k) {
+        case ERR_NONE: return "none"; case ERR_SYNTAX: return "syntax"; case ERR_TRAILING: return "trailing";
+        case ERR_1X1: return "1x1"; case ERR_ROW_MISMATCH: return "row mismatch"; case ERR_DIM_MISMATCH: return "dim mismatch";
+    }
+    return "?";
+}
+
+// Resumable body of a stepping engine. Every co_yield is one visualization event (one STEP in
+// the GUI); with animation off a yield does not suspend, so a single resume runs to the end.
+enum StepEvent { EV_NONE, EV_LEX, EV_TOKEN, EV_PARSE, EV_BREAK };
+
+// Every reset() starts a fresh coroutine, so freed frames are kept in per-thread free lists, one per
+// 64-byte size class, and handed out again instead of going back to the heap. Each list keeps at most
+// CAP frames; frames beyond that, and frames over 1 KB, go straight back to the heap. Engines with
+// static storage outlive the main thread's lists, so frames freed after ~Lists also go to the heap.
+struct FramePool {
+    static constexpr size_t GRAIN = 64, CLASSES = 16, CAP = 8;
+    struct Lists {
+        void* frames[CLASSES][CAP];
+        int count[CLASSES] = {};
+        ~Lists() { for (size_t c = 0; c < CLASSES; c++) while (count[c]) ::operator delete(frames[c][--count[c]]); gone() = true; }
+    };
+    static bool& gone() { thread_local bool g = false; return g; }   // trivially destructible, so still readable in ~Lists' wake
+    static Lists& lists() { thread_local Lists l; return l; }
+    static void* take(size_t n) {
+        size_t c = (n - 1) / GRAIN;
+        if (c >= CLASSES || gone()) return ::operator new(n);
+        Lists& l = lists();
+        return l.count[c] ? l.frames[c][--l.count[c]] : ::operator new((c + 1) * GRAIN);
+    }
+    static void give(void* p, size_t n) {
+        size_t c = (n - 1) / GRAIN;
+        if (c >= CLASSES || gone()) { ::operator delete(p); return; }
+        Lists& l = lists();
+        if (l.count[c] < (int)CAP) l.frames[c][l.count[c]++] = p;
+        else ::operator delete(p);
+    }
+};
+
+class StepTask {
+public:
+    struct promise_type {
+        StepEvent event = EV_NONE;
+        bool animate = true;
+        struct Yield {
+            bool skip;
+            bool await_ready() const noexcept { return skip; }
+            void await_suspend(coroutine_handle<>) const noexcept {}
+            void await_resume() const noexcept {}
+        };
+        StepTask get_return_object() { return StepTask(coroutine_handle<promise_type>::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        // A breakpoint suspends even a batch run.
+        Yield yield_value(StepEvent e) { event = e; return Yield{!animate && e != EV_BREAK}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+        static void* operator new(size_t n) { return FramePool::take(n); }
+        static void operator delete(void* p, size_t n) { FramePool::give(p, n); }
+    };
+
+    StepTask() = default;
+    explicit StepTask(coroutine_handle<promise_type> handle) : h(handle) {}
+    // Copies are empty: a copied engine keeps its state but cannot resume (RunCache copies finished runs only).
+    StepTask(const StepTask&) {}
+    StepTask& operator=(const StepTask& o) { if (this != &o) { if (h) h.destroy(); h = {}; } return *this; }
+    StepTask(StepTask&& o) noexcept : h(exchange(o.h, {})) {}
+    StepTask& operator=(StepTask&& o) noexcept { if (this != &o) { if (h) h.destroy(); h = exchange(o.h, {}); } return *this; }
+    ~StepTask() { if (h) h.destroy(); }
+
+    // Runs to the next yield (animate) or to the end (batch). False once the body has finished.
+    bool resume(bool animate) {
+        if (!h || h.done()) return false;
+        h.promise().animate = animate; h.resume();
+        return !h.done();
+    }
+    StepEvent event() const { return h ? h.promise().event : EV_NONE; }
+
+private:
+    coroutine_handle<promise_type> h;
+};
 
 // States
 enum NFAState { S_NONE, S0, S1, S2, S3, S4, S_FINAL };
@@ -28,263 +142,2721 @@ enum AnimMode { MODE_NONE, MODE_NFA, MODE_DFA };
 // PART 1: LEXER (NFA -> DFA Sequence)
 // ==========================================
 
-class Lexer {
+class Lexer {
+public:
+    string input;
+    int pos;
+    int tokenStart = 0;
+    AnimMode mode = MODE_NONE;
+    NFAState nfaState = S_NONE;
+    NFAState nfaTarget = S_NONE;
+    DFAState dfaState = D_NONE;
+    int dfaIdx = 0;
+    string currentNumBuild = "";
+    vector<Token> tokens;   // everything emitted so far; ends with END_TOKEN once done
+    StepTask task;
+
+    // The running coroutine points at this object, so a copy gets none (see StepTask): only
+    // finished lexers are worth copying.
+
+    void init(const string& s, int start = 0) {
+        input = s; pos = start; mode = MODE_NONE; 
+        tokens.clear();
+        task = run();
+    }
+    
+    // Runs the whole input through without pausing; the token list ends with END_TOKEN.
+    vector<Token> tokenizeAll() { task.resume(false); return tokens; }
+
+    char peek(int offset = 0) { if (pos + offset >= input.length()) return 0; return input[pos + offset]; }
+
+    // One co_yield per animation frame: the NFA trace, then the DFA check, then the token.
+    StepTask run() {
+        for (;;) {
+            while (pos < input.length() && isspace(input[pos])) pos++;
+            if (pos >= input.length()) { tokens.push_back({END_TOKEN, "EOF", (int)pos}); co_return; }
+
+            tokenStart = pos;
+            char c = peek();
+            if (!isdigit(c)) {
+                pos++;
+                if (c == '[') tokens.push_back({LBRACKET, "["});
+                else if (c == ']') tokens.push_back({RBRACKET, "]"});
+                else if (c == ',') tokens.push_back({COMMA, ","});
+                else if (c == '+') tokens.push_back({PLUS, "+"});
+                else if (c == '-') tokens.push_back({MINUS, "-"});
+                else if (c == '*') tokens.push_back({MULTIPLY, "*"});
+                else if (c == '(') tokens.push_back({LPAREN, "("});
+                else if (c == ')') tokens.push_back({RPAREN, ")"});
+                else tokens.push_back({UNKNOWN, string(1, c)});
+                tokens.back().offset = tokenStart;
+                co_yield EV_TOKEN;
+                continue;
+            }
+
+            // Thompson's NFA for digit+: 0 -d-> 1 -e-> 2, (2 -e-> 3 -d-> 4 -e-> 2)*, 2 -e-> F
+            mode = MODE_NFA; nfaState = S0; nfaTarget = S_NONE; currentNumBuild = ""; co_yield EV_LEX;
+            nfaTarget = S1; currentNumBuild += c; pos++; co_yield EV_LEX;
+            nfaState = S1; nfaTarget = S2; co_yield EV_LEX;
+            for (;;) {
+                nfaState = S2;
+                if (!isdigit(peek())) { nfaTarget = S_FINAL; co_yield EV_LEX; break; }
+                nfaTarget = S3; co_yield EV_LEX;
+                nfaState = S3; nfaTarget = S4; currentNumBuild += peek(); pos++; co_yield EV_LEX;
+                nfaState = S4; nfaTarget = S2; co_yield EV_LEX;
+            }
+            nfaState = S_FINAL; nfaTarget = S_NONE; mode = MODE_DFA; dfaState = D_START; dfaIdx = 0; co_yield EV_LEX;
+
+            // Optimized DFA re-reads the lexeme: Start -d-> Acc, Acc -d-> Acc
+            while (dfaIdx < currentNumBuild.length()) { dfaState = D_ACCEPT; dfaIdx++; co_yield EV_LEX; }
+            mode = MODE_NONE; dfaState = D_NONE;
+            tokens.push_back({NUMBER, currentNumBuild, tokenStart});
+            co_yield EV_TOKEN;
+        }
+    }
+};
+
+// ==========================================
+// PART 2: PDA
+// ==========================================
+
+struct LogEntry { string input, action, stackState; };
+
+// Trace text is built in place: Compose(s, parts...) overwrites s but keeps its capacity, so once
+// an engine has run, the strings it rebuilds every step stop allocating.
+inline void AppendPart(string& s, const string& p) { s += p; }
+inline void AppendPart(string& s, const char* p) { s += p; }
+inline void AppendPart(string& s, char c) { s += c; }
+template<class I> requires is_integral_v<I> void AppendPart(string& s, I v) { char buf[24]; s.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr); }
+template<class... P> void Compose(string& s, const P&... parts) { s.clear(); (AppendPart(s, parts), ...); }
+
+// `history` storage that survives clear(): records past size() keep their strings, and the next
+// push_back copies into them, so a reset is O(1) and re-running an input reuses every buffer.
+class TraceLog {
+public:
+    TraceLog() = default;
+    TraceLog(const TraceLog& o) : slots(o.begin(), o.end()), used(o.used) {}
+    TraceLog& operator=(const TraceLog& o) { if (this != &o) { used = 0; for (const LogEntry& e : o) push_back(e); } return *this; }
+    size_t size() const { return used; }
+    bool empty() const { return used == 0; }
+    void clear() { used = 0; }
+    const LogEntry& operator[](size_t i) const { return slots[i]; }
+    const LogEntry* begin() const { return slots.data(); }
+    const LogEntry* end() const { return slots.data() + used; }
+    void push_back(const LogEntry& e) { if (used == slots.size()) slots.push_back(e); else slots[used] = e; used++; }
+private:
+    vector<LogEntry> slots;
+    size_t used = 0;
+};
+
+// How much of the micro-step trace an engine keeps in `history`. Each level includes the ones
+// before it; errors and the final verdict are always kept, and never sampled away.
+enum TraceLevel { TRACE_ERRORS, TRACE_TOKENS, TRACE_RULES, TRACE_FULL };
+const char* TraceLevelNames[] = {"errors", "tokens", "rules", "full"};
+
+struct TraceFilter {
+    TraceLevel level = TRACE_FULL;
+    int sampleEvery = 1;            // keep 1 in N of the entries the level admits
+    long long seen = 0;
+    bool keep(TraceLevel l) {
+        if (l == TRACE_ERRORS) return true;
+        if (l > level) return false;
+        return ++seen % sampleEvery == 0;
+    }
+};
+
+// Trace files: a run's trace streamed to disk and browsed later through a memory map.
+//   header   "MTRACE1", step count, index and string-table offsets, index stride, string count
+//   records  per step: u32 input id, u32 action id, u32 stack length, stack bytes
+//   index    u64 file offset of every `stride`-th record
+//   strings  u32 start offsets (count + 1), then the bytes; inputs and actions are interned
+// Stack states are stored inline since nearly every step has a different one.
+struct TraceFileHeader {
+    char magic[8];
+    uint64_t steps, indexOffset, stringsOffset;
+    uint32_t stride, stringCount;
+};
+
+class TraceWriter {
+public:
+    uint32_t stride = 64;
+    uint64_t steps = 0;
+
+    ~TraceWriter() { close(); }
+    bool open(const string& path) {
+        close();
+        out.rdbuf()->pubsetbuf(buffer, sizeof(buffer));
+        out.open(path, ios::binary | ios::trunc);
+        if (!out) return false;
+        TraceFileHeader h = {};
+        out.write((const char*)&h, sizeof(h));
+        pos = sizeof(h); steps = 0; index.clear(); ids.clear(); strings.clear();
+        return true;
+    }
+    bool isOpen() const { return out.is_open(); }
+    void write(const LogEntry& e) {
+        if (!out.is_open()) return;
+        if (steps % stride == 0) index.push_back(pos);
+        uint32_t rec[3] = {intern(e.input), intern(e.action), (uint32_t)e.stackState.size()};
+        out.write((const char*)rec, sizeof(rec)); out.write(e.stackState.data(), e.stackState.size());
+        pos += sizeof(rec) + e.stackState.size(); steps++;
+    }
+    // Appends the index and string table and fills in the header. False if anything failed to write.
+    bool close() {
+        if (!out.is_open()) return true;
+        TraceFileHeader h = {{'M', 'T', 'R', 'A', 'C', 'E', '1', 0}, steps, pos, 0, stride, (uint32_t)strings.size()};
+        out.write((const char*)index.data(), index.size() * sizeof(uint64_t));
+        h.stringsOffset = pos + index.size() * sizeof(uint64_t);
+        uint32_t at = 0;
+        for (const string& str : strings) { out.write((const char*)&at, 4); at += (uint32_t)str.size(); }
+        out.write((const char*)&at, 4);
+        for (const string& str : strings) out.write(str.data(), str.size());
+        out.seekp(0); out.write((const char*)&h, sizeof(h));
+        bool ok = (bool)out;
+        out.close();
+        return ok;
+    }
+
+private:
+    ofstream out;
+    char buffer[1 << 16];
+    uint64_t pos = 0;
+    vector<uint64_t> index;
+    unordered_map<string, uint32_t> ids;
+    vector<string> strings;
+
+    uint32_t intern(const string& str) {
+        auto [it, added] = ids.try_emplace(str, (uint32_t)strings.size());
+        if (added) strings.push_back(str);
+        return it->second;
+    }
+};
+
+// Read side: the file is mapped, never loaded, so a 50M-step trace costs only the pages viewed.
+class TraceFile {
+public:
+    struct Step { string_view input, action, stackState; };
+
+    ~TraceFile() { close(); }
+    bool open(const string& path, string& error) {
+        close();
+        if (!map(path)) { error = "cannot map " + path; return false; }
+        TraceFileHeader h;
+        if (length < sizeof(h)) { error = "not a trace file"; close(); return false; }
+        memcpy(&h, base, sizeof(h));
+        uint64_t indexEntries = h.stride ? (h.steps + h.stride - 1) / h.stride : 0;
+        if (memcmp(h.magic, "MTRACE1", 8) != 0 || !h.stride || h.indexOffset + indexEntries * 8 > length ||
+            h.stringsOffset + (uint64_t)(h.stringCount + 1) * 4 > length) { error = "not a trace file, or not closed properly"; close(); return false; }
+        header = h;
+        stringStarts = (const uint32_t*)(base + h.stringsOffset);
+        stringBytes = base + h.stringsOffset + (uint64_t)(h.stringCount + 1) * 4;
+        return true;
+    }
+    bool isOpen() const { return base != NULL; }
+    uint64_t size() const { return isOpen() ? header.steps : 0; }
+    // Nearest indexed record, then at most stride - 1 records skipped.
+    Step at(uint64_t i) const {
+        Step bad = {"?", "corrupt record", ""};
+        if (i >= size()) return bad;
+        uint64_t off;
+        memcpy(&off, base + header.indexOffset + i / header.stride * 8, 8);
+        for (uint64_t k = i % header.stride; ; k--) {
+            uint32_t rec[3];
+            if (off + sizeof(rec) > header.indexOffset) return bad;
+            memcpy(rec, base + off, sizeof(rec));
+            if (off + sizeof(rec) + rec[2] > header.indexOffset) return bad;
+            if (k == 0) return {str(rec[0]), str(rec[1]), string_view(base + off + sizeof(rec), rec[2])};
+            off += sizeof(rec) + rec[2];
+        }
+    }
+    void close() {
+        UnmapFile(base, length);
+        base = NULL; length = 0;
+    }
+
+private:
+    const char* base = NULL;
+    size_t length = 0;
+    TraceFileHeader header = {};
+    const uint32_t* stringStarts = NULL;
+    const char* stringBytes = NULL;
+
+    string_view str(uint32_t id) const {
+        if (id >= header.stringCount) return "?";
+        uint32_t a, b;
+        memcpy(&a, stringStarts + id, 4); memcpy(&b, stringStarts + id + 1, 4);
+        if (a > b || stringBytes + b > base + length) return "?";
+        return string_view(stringBytes + a, b - a);
+    }
+    bool map(const string& path) { base = MapFile(path, length); return base != NULL; }
+};
+
+// Conditions that stop a run and hand the engine back to the stepper; -1, "" or false is off.
+// Each fires on the step its condition becomes true, so running on from a break finds the next one.
+struct Breakpoints {
+    int tokenIndex = -1;      // the token at this index is consumed
+    int stackDepth = -1;      // stack grows deeper than this
+    int rowLength = -1;       // currentRowLength exceeds this
+    char topSymbol[32] = "";  // this symbol comes to the top of the stack
+    bool onError = false;     // any triggerError, including recovered ones
+    bool armed() const { return tokenIndex >= 0 || stackDepth >= 0 || rowLength >= 0 || topSymbol[0] || onError; }
+};
+
+// Visualisation bookkeeping as an engine policy. FullTrace carries everything the GUI draws;
+// NullTrace carries nothing, and every use of it sits under `if constexpr (traced)`, so a
+// NullTrace engine only parses.
+struct FullTrace {
+    static constexpr bool traced = true;
+    string statusMessage, lastAction, lastOperation = "";
+    vector<string> justPushed;
+    TraceLog history;
+    TraceFilter trace;
+    Breakpoints breaks;
+    string breakReason;       // why the last run stopped short of the end
+    TraceWriter* sink = NULL;  // also stream every kept entry to a trace file
+    bool keepHistory = true;  // false: the file is the only copy, for traces too big for memory
+
+    LogEntry scratch;         // the entry being built, reused
+
+    void record(const LogEntry& e) {
+        if (sink) sink->write(e);
+        if (keepHistory) history.push_back(e);
+    }
+
+    // Called after every parse step while breakpoints are armed; true when one fires.
+    template<class TopName> bool breakHit(int cursor, int depth, int rowLength, size_t errors, TopName topName) {
+        const Breakpoints& b = breaks;
+        BreakProbe now = {cursor, depth, rowLength, b.topSymbol[0] && strcmp(topName(), b.topSymbol) == 0, errors};
+        string why;
+        if (b.tokenIndex >= 0 && probe.cursor <= b.tokenIndex && cursor > b.tokenIndex) why = "token " + to_string(b.tokenIndex) + " consumed";
+        else if (b.stackDepth >= 0 && probe.depth <= b.stackDepth && depth > b.stackDepth) why = "stack depth " + to_string(depth);
+        else if (now.onTop && !probe.onTop) why = string(b.topSymbol) + " on top";
+        else if (b.rowLength >= 0 && probe.rowLength <= b.rowLength && rowLength > b.rowLength) why = "row length " + to_string(rowLength);
+        else if (b.onError && errors > probe.errors) why = "error raised";
+        probe = now;
+        if (why.empty()) return false;
+        breakReason = why; Compose(statusMessage, "BREAK: ", why);
+        return true;
+    }
+    void resetBreaks() { probe = BreakProbe(); breakReason.clear(); }
+private:
+    struct BreakProbe { int cursor = 0, depth = 0, rowLength = 0; bool onTop = false; size_t errors = 0; };
+    BreakProbe probe;         // state after the previous step, for edge triggering
+};
+struct NullTrace { static constexpr bool traced = false; };
+
+// Phase 1, shared by every stepping engine: resume the lexer coroutine (to its next frame, or to
+// the end in batch mode) and log the tokens it produced. Returns false once lexing is done.
+template<class E> bool PumpLexer(E& e, const char* parserName) {
+    Lexer& lexer = e.lexer;
+    size_t before = lexer.tokens.size();
+    bool more = lexer.task.resume(e.animating);
+    e.tokenStream.insert(e.tokenStream.end(), lexer.tokens.begin() + before, lexer.tokens.end());
+    if constexpr (E::traced) {
+        for (size_t i = before; i < lexer.tokens.size(); i++) {
+            Compose(e.lastAction, "Lexer: Generated ", lexer.tokens[i].value);
+            e.addLog(TRACE_TOKENS, "Token: ", lexer.tokens[i].value);
+        }
+        if (!more) {
+            Compose(e.statusMessage, "Phase 2: Parsing (", parserName, ")");
+            Compose(e.lastAction, "Lexing Done. Starting ", parserName, ".");
+        } else if (lexer.tokens.size() == before) {
+            if (lexer.mode == MODE_NFA) e.lastAction = "Lexer: 1. NFA Running...";
+            else if (lexer.mode == MODE_DFA) e.lastAction = "Lexer: 2. DFA Verifying...";
+        }
+    }
+    if (!more) e.lexingPhase = false;
+    return more;
+}
+struct ParseError { ErrorKind kind; string message; int tokenIndex, offset; };
+
+string ShapeText(int rows, int cols) { return to_string(rows) + "x" + to_string(cols); }
+
+// Shape rule of one binary operator: equal shapes for + and -, matching inner dimension for *.
+ErrorKind CheckShapes(char op, int r1, int c1, int r2, int c2, string& message) {
+    if (op == '*' ? c1 == r2 : (r1 == r2 && c1 == c2)) return ERR_NONE;
+    message = string(op == '*' ? "Inner Dimension Mismatch! " : "Dimension Mismatch! ") +
+              "Matrix 1 is " + ShapeText(r1, c1) + ", Matrix 2 is " + ShapeText(r2, c2);
+    return ERR_DIM_MISMATCH;
+}
+
+// Row/operand shape inference, shared by every validator so they all reject the same inputs.
+// Tracks rows x cols per operand and applies the operator's rule as early as each row allows.
+struct SemanticChecker {
+    int expectedRowLength = -1, currentRowLength = 0;
+    bool inRow = false;
+    int rows = 0;                   // completed rows of the current operand
+    char op = 0;                    // operator between Matrix 1 and Matrix 2, once matched
+    int matrix1Rows = -1, matrix1Cols = -1;
+    bool poisoned = false;          // recovery: a syntax error in this operand, its shape is unknown
+    bool partial = false;           // recovery: a row of this operand failed and was dropped
+    bool scaleNext = false;         // the next num is the scalar prefix (an @scale rule was expanded)
+    string message;
+
+    void beginRow() { inRow = true; currentRowLength = 0; }
+    // After a syntax error nothing more is stored or checked for this operand.
+    void poison() { poisoned = true; inRow = false; currentRowLength = 0; }
+    // Row-closing ']'. On error the row stays open and `message` holds the reason.
+    ErrorKind closeRow() {
+        // Check 1: Minimum Size (1x1 not allowed)
+        if (currentRowLength < 2) { message = "Invalid Matrix: 1x1 not allowed"; return ERR_1X1; }
+        // Check 2: Matrix 2 vs Matrix 1, as far as the rows seen so far can tell
+        if (matrix1Cols != -1 && (op == '+' || op == '-')) {
+            if (currentRowLength != matrix1Cols) {
+                message = "Dimension Mismatch! Matrix 1=" + to_string(matrix1Cols) + ", Matrix 2=" + to_string(currentRowLength);
+                return ERR_DIM_MISMATCH;
+            }
+            if (rows + 1 > matrix1Rows) {
+                message = "Dimension Mismatch! Matrix 1 has " + to_string(matrix1Rows) + " row(s), Matrix 2 has more";
+                return ERR_DIM_MISMATCH;
+            }
+        }
+        if (matrix1Cols != -1 && op == '*' && rows + 1 > matrix1Cols) {
+            message = "Inner Dimension Mismatch! Matrix 1 has " + to_string(matrix1Cols) + " col(s), Matrix 2 has more rows";
+            return ERR_DIM_MISMATCH;
+        }
+        // Check 3: Row Consistency
+        if (expectedRowLength == -1) expectedRowLength = currentRowLength;
+        else if (currentRowLength != expectedRowLength) {
+            message = "Row Mismatch! Exp " + to_string(expectedRowLength) + ", Got " + to_string(currentRowLength);
+            return ERR_ROW_MISMATCH;
+        }
+        rows++; currentRowLength = 0; inRow = false;
+        return ERR_NONE;
+    }
+    // A Matrix 1 that lost rows to recovery has no trustworthy shape, so Matrix 2 is not compared with it.
+    void operatorSeen(char o) {
+        op = o;
+        if (expectedRowLength != -1 && !poisoned && !partial) { matrix1Cols = expectedRowLength; matrix1Rows = rows; }
+        expectedRowLength = -1; currentRowLength = 0; inRow = false; rows = 0; poisoned = partial = false;
+    }
+    // End of input: what closeRow() could not know yet, i.e. Matrix 2 having too few rows.
+    ErrorKind finish() {
+        if (matrix1Cols == -1 || expectedRowLength == -1 || poisoned || partial) return ERR_NONE;
+        return CheckShapes(op, matrix1Rows, matrix1Cols, rows, expectedRowLength, message);
+    }
+};
+
+// Dense row-major operand, filled by the PDA's semantic actions while parsing. `scale` is the
+// optional scalar prefix (the 2 in 2[[1,2],[3,4]]); evaluation multiplies it in. The parsers count
+// non-zeros as they store numbers. The evaluator may hold a mostly-zero factor of a product in
+// compressed sparse rows instead: row i's non-zeros are values[rowStart[i]] .. values[rowStart[i + 1] - 1],
+// in columns colIndex[...], and `data` is empty.
+struct Matrix {
+    int rows = 0, cols = 0; vector<double> data; double scale = 1;
+    long long nonzeros = -1;   // -1: not counted
+    vector<int> rowStart, colIndex; vector<double> values;
+    bool sparse() const { return !rowStart.empty(); }
+};
+
+// Operand storage that outlives a reset: the engines park each operand's buffer in a spare list
+// and take one back when the next run opens an operand, so a repeat validation keeps its capacity.
+void RecycleOperands(vector<Matrix>& operands, vector<vector<double>>& spare) {
+    for (Matrix& m : operands) { m.data.clear(); spare.push_back(move(m.data)); }
+    operands.clear();
+}
+// Recovery drops a row that failed; its values are already stored, so cut the operand back to the row's start.
+void DropRow(Matrix& m, int length) {
+    for (; length > 0 && !m.data.empty(); length--) { m.nonzeros -= m.data.back() != 0; m.data.pop_back(); }
+}
+void NewOperand(vector<Matrix>& operands, vector<vector<double>>& spare) {
+    operands.emplace_back().nonzeros = 0;
+    if (!spare.empty()) { operands.back().data = move(spare.back()); spare.pop_back(); }
+}
+
+// The PDA's built-in grammar, fixed at compile time. Symbols are bytes: terminals first (in the order
+// LALRTables numbers them), then nonterminals. Right-hand sides are in consumption order; the
+// PDA pushes them reversed, so M's optional scalar comes before Core.
+enum Sym : unsigned char {
+    SYM_END, SYM_LBRACKET, SYM_RBRACKET, SYM_COMMA, SYM_PLUS, SYM_MINUS, SYM_MULTIPLY, SYM_NUM,
+    SYM_BAD,                        // any token the grammar never uses: (, ), unknown characters
+    NUM_TERMINALS,
+    SYM_S = NUM_TERMINALS, SYM_OP, SYM_M, SYM_SOPT, SYM_CORE, SYM_INSIDE, SYM_ROWLIST, SYM_ROW, SYM_ROWTAIL,
+    SYM_NUMLIST, SYM_NUMTAIL, NUM_SYMBOLS
+};
+constexpr const char* SymName[NUM_SYMBOLS] = {"$", "[", "]", ",", "+", "-", "*", "num", "?",
+    "S", "OP", "M", "S_OPT", "Core", "Inside", "RowList", "Row", "RowTail", "NumList", "NumTail"};
+// Error raised when a nonterminal cannot expand on the lookahead. Nonterminals without one
+// expand anyway and let a terminal further down report the error, as the PDA always did.
+constexpr const char* SyntaxError[NUM_SYMBOLS] = {"", "", "", "", "", "", "", "", "",
+    nullptr, "Expected OP", nullptr, nullptr, "Exp [", "Invalid", nullptr, "Row needs [", nullptr, "Exp Num", nullptr};
+
+constexpr Sym SymOf(TokenType t) {
+    switch (t) {
+        case END_TOKEN: return SYM_END; case LBRACKET: return SYM_LBRACKET; case RBRACKET: return SYM_RBRACKET;
+        case COMMA: return SYM_COMMA; case PLUS: return SYM_PLUS; case MINUS: return SYM_MINUS;
+        case MULTIPLY: return SYM_MULTIPLY; case NUMBER: return SYM_NUM; default: return SYM_BAD;
+    }
+}
+
+// Semantic hooks a rule can carry; they fire when the PDA expands it.
+enum RuleHook { HOOK_OPERAND = 1, HOOK_ROW = 2, HOOK_SCALE = 4 };   // start a new operand / start counting a row / the num is a scalar prefix
+
+constexpr int MAX_SYMBOLS = 64, MAX_RULES = 96, MAX_RHS = 8, MAX_NAME = 24, MAX_ERROR = 32;
+struct Rule { Sym lhs; unsigned char len, hooks; Sym rhs[MAX_RHS]; };
+constexpr Rule Grammar[] = {
+    {SYM_S, 3, 0, {SYM_M, SYM_OP, SYM_M}},
+    {SYM_OP, 1, 0, {SYM_PLUS}}, {SYM_OP, 1, 0, {SYM_MINUS}}, {SYM_OP, 1, 0, {SYM_MULTIPLY}},
+    {SYM_M, 2, HOOK_OPERAND, {SYM_SOPT, SYM_CORE}},
+    {SYM_SOPT, 1, HOOK_SCALE, {SYM_NUM}}, {SYM_SOPT, 0, 0, {}},
+    {SYM_CORE, 3, 0, {SYM_LBRACKET, SYM_INSIDE, SYM_RBRACKET}},
+    {SYM_INSIDE, 1, 0, {SYM_ROWLIST}}, {SYM_INSIDE, 1, HOOK_ROW, {SYM_NUMLIST}},
+    {SYM_ROWLIST, 2, 0, {SYM_ROW, SYM_ROWTAIL}},
+    {SYM_ROW, 3, HOOK_ROW, {SYM_LBRACKET, SYM_NUMLIST, SYM_RBRACKET}},
+    {SYM_ROWTAIL, 2, 0, {SYM_COMMA, SYM_ROWLIST}}, {SYM_ROWTAIL, 0, 0, {}},
+    {SYM_NUMLIST, 2, 0, {SYM_NUM, SYM_NUMTAIL}},
+    {SYM_NUMTAIL, 2, 0, {SYM_COMMA, SYM_NUMLIST}}, {SYM_NUMTAIL, 0, 0, {}},
+};
+
+// A compiled grammar: rules, symbol names, FIRST/FOLLOW and the predict table. Cells hold a rule
+// index or -1. `fallback` is what an empty cell expands to: the epsilon rule of a nullable
+// nonterminal, or the only rule of one without its own syntax error (the LL analogue of a
+// default reduction). Fixed-size and trivially copyable, so the built-in grammar is a constexpr
+// value and a grammar file compiles into the same layout and caches as raw bytes.
+struct LL1Table {
+    int numSymbols = 0, numRules = 0;
+    Sym start = SYM_S;
+    Rule rules[MAX_RULES] = {};
+    char names[MAX_SYMBOLS][MAX_NAME] = {};
+    char errors[MAX_SYMBOLS][MAX_ERROR] = {};       // empty: expand the fallback instead
+    unsigned first[MAX_SYMBOLS] = {}, follow[MAX_SYMBOLS] = {};   // terminal bitmasks
+    bool nullable[MAX_SYMBOLS] = {};
+    signed char predict[MAX_SYMBOLS][NUM_TERMINALS] = {};
+    signed char fallback[MAX_SYMBOLS] = {};
+    int conflicts = 0, ruleless = 0;
+
+    constexpr int rule(Sym A, Sym t) const { return predict[A][t] >= 0 ? predict[A][t] : fallback[A]; }
+    int find(const string& name) const {
+        for (int i = 0; i < numSymbols; i++) if (name == names[i]) return i;
+        return -1;
+    }
+};
+
+// Shared by the constexpr built-in grammar and by grammar files compiled at startup.
+// `errors[A]` may be null for nonterminals that should fall back instead of failing.
+constexpr LL1Table BuildLL1(const Rule* g, int numRules, const char* const* names, const char* const* errors, int numSymbols, Sym start) {
+    LL1Table T;
+    T.numSymbols = numSymbols; T.numRules = numRules; T.start = start;
+    auto copy = [](char* dst, const char* src, int cap) { int i = 0; for (; src && src[i] && i < cap - 1; i++) dst[i] = src[i]; dst[i] = 0; };
+    for (int s = 0; s < numSymbols; s++) { copy(T.names[s], names[s], MAX_NAME); if (s >= NUM_TERMINALS) copy(T.errors[s], errors[s], MAX_ERROR); }
+    for (int p = 0; p < numRules; p++) T.rules[p] = g[p];
+    for (int t = 0; t < NUM_TERMINALS; t++) T.first[t] = 1u << t;
+    T.follow[start] = 1u << SYM_END;
+    // FIRST of rhs[from..len) into `f`; returns whether that suffix is nullable
+    auto firstOf = [&T](const Rule& r, int from, unsigned& f) {
+        for (int i = from; i < r.len; i++) { f |= T.first[r.rhs[i]]; if (!T.nullable[r.rhs[i]]) return false; }
+        return true;
+    };
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int p = 0; p < numRules; p++) {
+            const Rule& r = g[p];
+            unsigned f = T.first[r.lhs];
+            bool n = firstOf(r, 0, f) || T.nullable[r.lhs];
+            if (f != T.first[r.lhs] || n != T.nullable[r.lhs]) { T.first[r.lhs] = f; T.nullable[r.lhs] = n; changed = true; }
+        }
+    }
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int p = 0; p < numRules; p++) {
+            const Rule& r = g[p];
+            for (int i = 0; i < r.len; i++) {
+                Sym X = r.rhs[i];
+                if (X < NUM_TERMINALS) continue;
+                unsigned f = T.follow[X];
+                if (firstOf(r, i + 1, f)) f |= T.follow[r.lhs];
+                if (f != T.follow[X]) { T.follow[X] = f; changed = true; }
+            }
+        }
+    }
+    for (int A = 0; A < MAX_SYMBOLS; A++) {
+        T.fallback[A] = -1;
+        for (int t = 0; t < NUM_TERMINALS; t++) T.predict[A][t] = -1;
+    }
+    int ruleCount[MAX_SYMBOLS] = {}, lastRule[MAX_SYMBOLS] = {};
+    for (int p = 0; p < numRules; p++) {
+        const Rule& r = g[p];
+        unsigned f = 0;
+        if (firstOf(r, 0, f)) { f |= T.follow[r.lhs]; T.fallback[r.lhs] = (signed char)p; }
+        for (int t = 0; t < NUM_TERMINALS; t++) {
+            if (!(f & (1u << t))) continue;
+            if (T.predict[r.lhs][t] >= 0) T.conflicts++;
+            else T.predict[r.lhs][t] = (signed char)p;
+        }
+        ruleCount[r.lhs]++; lastRule[r.lhs] = p;
+    }
+    for (int A = NUM_TERMINALS; A < numSymbols; A++) {
+        if (ruleCount[A] == 0) T.ruleless++;
+        else if (ruleCount[A] == 1 && T.fallback[A] < 0 && !T.errors[A][0]) T.fallback[A] = (signed char)lastRule[A];
+    }
+    return T;
+}
+
+constexpr LL1Table LL1 = BuildLL1(Grammar, sizeof(Grammar) / sizeof(Rule), SymName, SyntaxError, NUM_SYMBOLS, SYM_S);
+static_assert(LL1.conflicts == 0, "matrix grammar is not LL(1): two rules predict on the same lookahead");
+static_assert(LL1.ruleless == 0, "matrix grammar has a nonterminal without rules");
+
+// Grammar files feed the same builder at startup instead of at compile time:
+//
+//     # comment
+//     S       -> M OP M ;
+//     M       -> num? Core @operand ;
+//     Core    -> "[" Inside "]" ! "Exp [" ;
+//     NumList -> num ("," num)* ;
+//
+// The first rule's left side is the start symbol. Terminals are the lexer's tokens, quoted, plus
+// `num`. `( )`, `?` and `*` are rewritten into fresh nonterminals. `@operand` and `@row` attach a
+// hook to the alternative they appear in; `! "text"` sets the syntax error of the left side.
+class GrammarCompiler {
+public:
+    string error;
+    int line = 1;
+
+    bool compile(const string& text, LL1Table& out) {
+        src = text; pos = 0; line = 1;
+        names.assign(SymName, SymName + NUM_TERMINALS); errs.assign(NUM_TERMINALS, ""); rules.clear();
+        int start = -1;
+        next();
+        while (kind != TK_END) {
+            if (kind != TK_IDENT) return fail("expected a rule name");
+            int lhs = symbol(text_);
+            if (lhs < 0) return false;
+            if (lhs < NUM_TERMINALS) return fail("terminal '" + text_ + "' on the left side");
+            if (start < 0) start = lhs;
+            next();
+            if (!expect("->") || !alternatives(lhs)) return false;
+            if (is("!")) {
+                next();
+                if (kind != TK_STRING) return fail("expected a message after '!'");
+                errs[lhs] = text_; next();
+            }
+            if (!expect(";")) return false;
+        }
+        if (start < 0) return fail("no rules");
+        if ((int)rules.size() > MAX_RULES) return fail("more than " + to_string(MAX_RULES) + " rules");
+        vector<const char*> n, e;
+        for (size_t i = 0; i < names.size(); i++) { n.push_back(names[i].c_str()); e.push_back(errs[i].empty() ? nullptr : errs[i].c_str()); }
+        out = BuildLL1(rules.data(), (int)rules.size(), n.data(), e.data(), (int)names.size(), (Sym)start);
+        for (int A = NUM_TERMINALS; A < out.numSymbols && out.ruleless; A++) {
+            bool has = false;
+            for (const Rule& r : rules) has = has || r.lhs == A;
+            if (!has) return fail("'" + names[A] + "' is used but has no rules");
+        }
+        if (out.conflicts) return fail("not LL(1): " + to_string(out.conflicts) + " predict conflict(s)");
+        return true;
+    }
+
+private:
+    enum { TK_END, TK_IDENT, TK_STRING, TK_PUNCT };
+    string src, text_;
+    size_t pos = 0;
+    int kind = TK_END;
+    vector<string> names, errs;
+    vector<Rule> rules;
+
+    bool fail(const string& msg) { error = to_string(line) + ": " + msg; return false; }
+    bool is(const char* p) const { return kind == TK_PUNCT && text_ == p; }
+    bool expect(const char* p) { if (!is(p)) return fail(string("expected '") + p + "'"); next(); return true; }
+    void next() {
+        for (;;) {
+            while (pos < src.size() && isspace((unsigned char)src[pos])) { if (src[pos] == '\n') line++; pos++; }
+            if (pos < src.size() && src[pos] == '#') { while (pos < src.size() && src[pos] != '\n') pos++; continue; }
+            break;
+        }
+        text_.clear();
+        if (pos >= src.size()) { kind = TK_END; return; }
+        char c = src[pos];
+        if (isalpha((unsigned char)c) || c == '_') {
+            kind = TK_IDENT;
+            while (pos < src.size() && (isalnum((unsigned char)src[pos]) || src[pos] == '_')) text_ += src[pos++];
+        } else if (c == '"') {
+            kind = TK_STRING; pos++;
+            while (pos < src.size() && src[pos] != '"' && src[pos] != '\n') text_ += src[pos++];
+            pos++;
+        } else {
+            kind = TK_PUNCT;
+            text_ = src.compare(pos, 2, "->") == 0 ? "->" : string(1, c);
+            pos += text_.size();
+        }
+    }
+    int symbol(const string& name) {
+        for (size_t i = 0; i < names.size(); i++) if (names[i] == name) return (int)i;
+        if ((int)names.size() == MAX_SYMBOLS) return fail("more than " + to_string(MAX_SYMBOLS) + " symbols"), -1;
+        if ((int)name.size() >= MAX_NAME) return fail("name '" + name + "' is too long"), -1;
+        names.push_back(name); errs.push_back("");
+        return (int)names.size() - 1;
+    }
+    int fresh(int base) { return symbol(names[base] + "#" + to_string(names.size())); }
+
+    // alt ('|' alt)* for `lhs`; each alternative becomes one rule
+    bool alternatives(int lhs) {
+        for (;;) {
+            Rule r = {(Sym)lhs, 0, 0, {}};
+            while (kind == TK_IDENT || kind == TK_STRING || is("(") || is("@")) {
+                if (is("@")) {
+                    next();
+                    if (text_ == "operand") r.hooks |= HOOK_OPERAND;
+                    else if (text_ == "row") r.hooks |= HOOK_ROW;
+                    else if (text_ == "scale") r.hooks |= HOOK_SCALE;
+                    else return fail("unknown hook '@" + text_ + "'");
+                    next(); continue;
+                }
+                int sym = item(lhs);
+                if (sym < 0) return false;
+                if (r.len == MAX_RHS) return fail("alternative longer than " + to_string(MAX_RHS) + " symbols");
+                r.rhs[r.len++] = (Sym)sym;
+            }
+            rules.push_back(r);
+            if (!is("|")) return true;
+            next();
+        }
+    }
+    // atom ('?' | '*')?
+    int item(int lhs) {
+        int sym;
+        if (kind == TK_STRING) {
+            sym = -1;
+            for (int t = SYM_LBRACKET; t <= SYM_NUM; t++) if (text_ == SymName[t]) sym = t;
+            if (sym < 0) return fail("\"" + text_ + "\" is not a token"), -1;
+            next();
+        } else if (is("(")) {
+            next();
+            sym = fresh(lhs);
+            if (sym < 0 || !alternatives(sym) || !expect(")")) return -1;
+        } else {
+            sym = symbol(text_);
+            if (sym < 0) return -1;
+            next();
+        }
+        if (is("?") || is("*")) {
+            bool star = is("*");
+            int n = fresh(lhs);
+            if (n < 0) return -1;
+            rules.push_back(star ? Rule{(Sym)n, 2, 0, {(Sym)sym, (Sym)n}} : Rule{(Sym)n, 1, 0, {(Sym)sym}});
+            rules.push_back(Rule{(Sym)n, 0, 0, {}});
+            next();
+            sym = n;
+        }
+        return sym;
+    }
+};
+
+static_assert(is_trivially_copyable_v<LL1Table>, "grammar caches are raw LL1Table bytes");
+
+uint64_t Fnv1a(const string& s, uint64_t h = 1469598103934665603ull) {
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ull; }
+    return h;
+}
+
+// Loads a grammar file through its binary cache (`path` + ".bin"). The cache starts with a hash
+// of the file text and the table layout; on a mismatch the file is recompiled and the cache rewritten.
+bool LoadGrammarFile(const string& path, LL1Table& out, string& error, bool& cached) {
+    ifstream in(path, ios::binary);
+    if (!in) { error = "cannot open " + path; return false; }
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    uint64_t key = Fnv1a(to_string(sizeof(LL1Table)), Fnv1a(text));
+    string cachePath = path + ".bin";
+    static LL1Table scratch;   // ~6 KB, too big to want on the stack twice
+    uint64_t stored = 0;
+    ifstream cache(cachePath, ios::binary);
+    if (cache.read((char*)&stored, sizeof stored) && stored == key && cache.read((char*)&scratch, sizeof scratch)) {
+        out = scratch; cached = true; return true;
+    }
+    cached = false;
+    GrammarCompiler gc;
+    if (!gc.compile(text, scratch)) { error = path + ":" + gc.error; return false; }
+    out = scratch;
+    ofstream w(cachePath, ios::binary | ios::trunc);
+    w.write((const char*)&key, sizeof key); w.write((const char*)&out, sizeof out);
+    return true;
+}
+
+// The grammar new engines start with: the built-in one unless a grammar file was loaded.
+LL1Table loadedGrammar;
+const LL1Table* activeGrammar = &LL1;
+
+// The early shape check (StructuralIndexer), FastValidator, LALR's shift semantics and expression
+// leaves are hand-written for the built-in language. They run only under a grammar whose rules are
+// the built-in ones, as matrix.grammar's are; under any other grammar they are off.
+// A grammar file numbers its symbols in order of appearance, so rules are compared by symbol name.
+bool BuiltinRules(const LL1Table* g) {
+    if (g == &LL1) return true;
+    auto same = [g](Sym a, Sym b) { return strcmp(g->names[a], LL1.names[b]) == 0; };
+    if (g->numRules != LL1.numRules || !same(g->start, LL1.start)) return false;
+    for (int p = 0; p < g->numRules; p++) {
+        const Rule &a = g->rules[p], &b = LL1.rules[p];
+        if (!same(a.lhs, b.lhs) || a.len != b.len || a.hooks != b.hooks) return false;
+        for (int i = 0; i < a.len; i++) if (!same(a.rhs[i], b.rhs[i])) return false;
+    }
+    return true;
+}
+const char* const CustomGrammarNote = "the early shape check, the fast validators, LALR's shape checks and expressions are off under a grammar that is not the built-in one";
+
+// Top-down PDA. `Trace` is FullTrace for the GUI or NullTrace for parse-only batch work.
+template<class Trace> class BasicParserEngine : public Trace {
+public:
+    using Trace::traced;
+    vector<Sym> pdaStack;             // bottom ... top
+    const LL1Table* grammar = activeGrammar;
+    Lexer lexer;
+    vector<Token> tokenStream;
+    int tokenCursor = 0;
+    bool lexingPhase = true; 
+    bool isLocked = false, isFinished = false;
+    
+    SemanticChecker sem;
+    vector<Matrix> operands; 
+    vector<vector<double>> spareBuffers;   // operand storage kept from earlier runs
+    ErrorKind errorKind = ERR_NONE;   // first error only, so verdicts stay comparable
+    int errorOffset = -1;
+    bool recoverErrors = false;       // panic-mode recovery: collect every error in one pass
+    bool operatorMatched = false;
+    vector<ParseError> errors;
+    bool earlyShapeCheck = true;      // shape inference pass between lexing and the PDA
+    size_t reservedSize[2] = {0, 0};
+    StepTask task;
+    bool animating = true;
+
+    void reset(const string& input) {
+        pdaStack.assign({SYM_END, grammar->start});
+        lexer.init(input); tokenStream.clear(); tokenCursor = 0;
+        lexingPhase = true; isLocked = false; isFinished = false;
+        sem = SemanticChecker(); RecycleOperands(operands, spareBuffers); errorKind = ERR_NONE; errorOffset = -1; 
+        operatorMatched = false; errors.clear();
+        if constexpr (traced) {
+            this->statusMessage = "Phase 1: Lexing"; this->lastAction = "Init"; this->lastOperation = "";
+            this->justPushed.clear(); this->history.clear(); this->trace.seen = 0; this->resetBreaks(); addLog(TRACE_FULL, "Init");
+        }
+        task = body();
+    }
+
+    // Skip the lexing phase and parse already-lexed tokens from `start` (M parses a single literal).
+    void resetTokens(const vector<Token>& tokens, int start = -1) {
+        reset("");
+        tokenStream = tokens; lexingPhase = false;
+        if (start >= 0) pdaStack.back() = (Sym)start;
+        if constexpr (traced) this->statusMessage = "Phase 2: Parsing (PDA)";
+    }
+    // Shape inference before the PDA stores a single value (defined after FastValidator).
+    void inferShapes();
+    vector<string> stackView() const {
+        vector<string> v;
+        for (auto it = pdaStack.rbegin(); it != pdaStack.rend(); ++it) v.push_back(grammar->names[*it]);
+        return v;
+    }
+
+    void triggerError(const string& msg, ErrorKind kind = ERR_SYNTAX) {
+        int offset = lexingPhase ? -1 : tokenStream[tokenCursor].offset;
+        if (errors.empty()) { errorKind = kind; errorOffset = offset; }
+        errors.push_back({kind, msg, tokenCursor, offset});
+        if constexpr (traced) {
+            addLog(TRACE_ERRORS, "ERROR: ", msg);
+            if (!recoverErrors) { Compose(this->statusMessage, "ERROR: ", msg); this->lastAction = "STOPPED"; }
+            else Compose(this->lastAction, "Recovering: ", msg);
+        }
+        if (!recoverErrors) { isLocked = true; return; }
+        if (kind == ERR_SYNTAX) synchronize();
+    }
+    // Panic mode: drop tokens up to the next ']', ',' or operator, then pop the stack until
+    // its top can consume that token. Every call pops or skips something, so it terminates.
+    void synchronize() {
+        // The operand's shape is unknown from here on: checking it would only produce follow-on errors.
+        if (sem.inRow && !sem.poisoned && !operands.empty()) DropRow(operands.back(), sem.currentRowLength);
+        sem.poison(); sem.scaleNext = false;
+        for (;;) {
+            TokenType t = tokenStream[tokenCursor].type;
+            bool isOp = (t == PLUS || t == MINUS || t == MULTIPLY);
+            if (t == END_TOKEN || t == RBRACKET || t == COMMA || (isOp && !operatorMatched)) break;
+            tokenCursor++;
+        }
+        while (!canResume(pdaStack.back(), SymOf(tokenStream[tokenCursor].type))) pdaStack.pop_back();
+        if constexpr (traced) addLog(TRACE_ERRORS, "Resync at ", tokenStream[tokenCursor].value);
+    }
+    // A terminal resumes on itself, a nonterminal on any lookahead with a real table entry.
+    bool canResume(Sym top, Sym t) const {
+        if (top == SYM_END) return true;
+        return top < NUM_TERMINALS ? top == t : grammar->predict[top][t] >= 0;
+    }
+    // Batch mode: one resume with animation off runs the coroutine to the end without suspending,
+    // or, on a traced engine with breakpoints armed, to the first one that fires.
+    void run() {
+        if constexpr (traced) { this->justPushed.clear(); this->lastOperation = ""; this->breakReason.clear(); }
+        if (isLocked || isFinished) return;
+        animating = false; task.resume(false);
+    }
+    void pushStack(const Rule& r) {
+        for (int i = r.len - 1; i >= 0; i--) pdaStack.push_back(r.rhs[i]);
+        if constexpr (traced) {
+            Compose(this->lastOperation, "PUSH ", (int)r.len); this->justPushed.resize(r.len);
+            for (int i = r.len - 1; i >= 0; i--) this->justPushed[r.len - 1 - i] = grammar->names[r.rhs[i]];
+            addLog(TRACE_RULES, "PUSH ", (int)r.len, " Rules");
+        }
+    }
+    template<class... P> void addLog(TraceLevel level, const P&... act) {
+        if (!this->trace.keep(level)) return;
+        LogEntry& e = this->scratch;
+        Compose(e.action, act...);
+        if (pdaStack.empty()) e.stackState = "empty";
+        else { e.stackState.clear(); for (Sym x : pdaStack) { e.stackState += grammar->names[x]; e.stackState += ' '; } }
+        if (lexingPhase) e.input = "LEX"; else if (tokenCursor < tokenStream.size()) e.input = tokenStream[tokenCursor].value; else e.input = "EOF";
+        this->record(e);
+    }
+
+    void step() {
+        if constexpr (traced) { this->justPushed.clear(); this->lastOperation = ""; this->breakReason.clear(); }
+        if (isLocked || isFinished) return;
+        animating = true; task.resume(true);
+    }
+
+    // The whole run as one coroutine; each co_yield is one STEP in the GUI.
+    StepTask body() {
+        // --- PHASE 1: LEXING ---
+        if (lexingPhase) {
+            while (PumpLexer(*this, "PDA")) co_yield EV_LEX;
+            inferShapes();
+            if (isLocked) co_return;
+            co_yield EV_LEX;
+        }
+        // --- PHASE 2: PARSING ---
+        while (!pdaStack.empty()) {
+            parseStep();
+            if (isLocked || isFinished) co_return;
+            if constexpr (traced) {
+                if (this->breaks.armed() && this->breakHit(tokenCursor, (int)pdaStack.size(), sem.currentRowLength, errors.size(),
+                                                           [&] { return grammar->names[pdaStack.back()]; }) && !animating) {
+                    addLog(TRACE_ERRORS, this->statusMessage); co_yield EV_BREAK; continue;
+                }
+            }
+            co_yield EV_PARSE;
+        }
+    }
+
+    void parseStep() {
+        Sym top = pdaStack.back();
+        const Token& currentToken = tokenStream[tokenCursor];
+        Sym t = SymOf(currentToken.type);
+
+        if (top == SYM_END) {
+            if (t != SYM_END) { triggerError("Trailing characters found", ERR_TRAILING); if (isLocked) return; }
+            else if (errors.empty()) {
+                ErrorKind err = sem.finish();
+                if (err != ERR_NONE) { triggerError(sem.message, err); if (isLocked) return; }
+            }
+            isFinished = true; pdaStack.pop_back();
+            if constexpr (traced) {
+                this->lastAction = "Done";
+                if (!errors.empty()) { Compose(this->statusMessage, "REJECTED: ", errors.size(), " error(s)"); addLog(TRACE_ERRORS, this->statusMessage); return; }
+                this->statusMessage = "ACCEPTED"; addLog(TRACE_ERRORS, "ACCEPTED");
+                for (size_t i = 0; i < operands.size(); i++) addLog(TRACE_RULES, "Operand ", i + 1, ": ", operands[i].rows, "x", operands[i].cols);
+            }
+            return; 
+        }
+
+        if (top < NUM_TERMINALS) {
+            if (top != t) { triggerError(string("Expected ") + grammar->names[top]); return; }
+            // --- STRICT SEMANTIC CHECKS ---
+            if (top == SYM_NUM && sem.scaleNext) {
+                sem.scaleNext = false;
+                if (!operands.empty()) operands.back().scale = strtod(currentToken.value.c_str(), NULL);
+            }
+            else if (top == SYM_NUM && sem.inRow && !sem.poisoned) {
+                sem.currentRowLength++;
+                double v = strtod(currentToken.value.c_str(), NULL);
+                operands.back().data.push_back(v); operands.back().nonzeros += v != 0;
+            }
+            else if (top == SYM_RBRACKET && sem.inRow && !sem.poisoned) {
+                bool firstRow = (sem.expectedRowLength == -1);
+                int rowLength = sem.currentRowLength;
+                ErrorKind err = sem.closeRow();
+                if (err != ERR_NONE) {
+                    triggerError(sem.message, err);
+                    if (isLocked) return;
+                    // Recovering: drop the bad row and keep checking the rest of the operand's rows.
+                    DropRow(operands.back(), rowLength);
+                    sem.inRow = false; sem.partial = true;
+                } else {
+                    if constexpr (traced) { if (firstRow) addLog(TRACE_FULL, "Set Dim: ", sem.expectedRowLength); }
+                    Matrix& m = operands.back();
+                    m.rows++; m.cols = rowLength;
+                }
+            }
+            else if (top == SYM_PLUS || top == SYM_MINUS || top == SYM_MULTIPLY) { 
+                sem.operatorSeen(grammar->names[top][0]); operatorMatched = true;
+                if constexpr (traced) { if (sem.matrix1Cols != -1) addLog(TRACE_FULL, "Locked Matrix 1 Shape: ", sem.matrix1Rows, "x", sem.matrix1Cols); }
+            }
+            
+            pdaStack.pop_back(); tokenCursor++;
+            if constexpr (traced) {
+                Compose(this->lastAction, "PDA: Matched ", grammar->names[top]); this->lastOperation = "POP & MATCH";
+                addLog(TRACE_TOKENS, "Match ", grammar->names[top]);
+            }
+        } else {
+            pdaStack.pop_back();
+            int r = grammar->rule(top, t);
+            if (r < 0) { triggerError(grammar->errors[top][0] ? string(grammar->errors[top]) : "Unexpected " + currentToken.value); return; }
+            const Rule& rule = grammar->rules[r];
+            if (rule.len == 0) { if constexpr (traced) addLog(TRACE_FULL, "Epsilon"); return; }
+            if (rule.hooks & HOOK_OPERAND) {
+                NewOperand(operands, spareBuffers);
+                if (operands.size() <= 2) operands.back().data.reserve(reservedSize[operands.size() - 1]);
+            }
+            pushStack(rule);
+            if (rule.hooks & HOOK_ROW) sem.beginRow();  // flat 1D literals count as a row too
+            if (rule.hooks & HOOK_SCALE) sem.scaleNext = true;
+        }
+    }
+};
+
+using ParserEngine = BasicParserEngine<FullTrace>;     // GUI, trace files, --validate
+using ParseOnlyEngine = BasicParserEngine<NullTrace>;  // verdict, errors and operands only
+
+// ==========================================
+// PART 3: FAST VALIDATOR (Recursive Descent)
+// ==========================================
+
+// Same grammar and semantic checks as ParserEngine, but walked directly over the
+// input bytes: no token objects, no explicit stack, no trace. For batch use.
+struct ValidationResult {
+    ErrorKind kind = ERR_NONE; int offset = -1; string message;
+    int rows1 = 0, cols1 = 0, rows2 = 0, cols2 = 0; // inferred operand shapes when accepted
+    bool ok() const { return kind == ERR_NONE; }
+};
+
+class FastValidator {
+public:
+    ValidationResult validate(const char* s, size_t n) {
+        base = s; p = s; end = s + n; sem = SemanticChecker(); result = ValidationResult();
+        next();
+        if (matrix() && op() && matrix()) {
+            if (tok != END_TOKEN) fail(ERR_TRAILING, "Trailing characters found");
+            else if (sem.finish() != ERR_NONE) fail(ERR_DIM_MISMATCH, sem.message);
+            else { result.rows1 = sem.matrix1Rows; result.cols1 = sem.matrix1Cols; result.rows2 = sem.rows; result.cols2 = sem.expectedRowLength; }
+        }
+        return result;
+    }
+    ValidationResult validate(const string& s) { return validate(s.data(), s.size()); }
+
+private:
+    const char *base = NULL, *p = NULL, *end = NULL, *tokStart = NULL;
+    TokenType tok = NONE_TOKEN;
+    SemanticChecker sem;
+    ValidationResult result;
+
+    // Inline lexer: identical token boundaries to Lexer (C-locale isspace/isdigit), without building strings.
+    static bool digit(char c) { return (unsigned char)(c - '0') < 10; }
+    static bool space(char c) { return c == ' ' || (unsigned char)(c - '\t') < 5; }
+    void next() {
+        while (p < end && space(*p)) p++;
+        tokStart = p;
+        if (p >= end) { tok = END_TOKEN; return; }
+        char c = *p++;
+        if (digit(c)) { while (p < end && digit(*p)) p++; tok = NUMBER; return; }
+        switch (c) {
+            case '[': tok = LBRACKET; break; case ']': tok = RBRACKET; break; case ',': tok = COMMA; break;
+            case '+': tok = PLUS; break; case '-': tok = MINUS; break; case '*': tok = MULTIPLY; break;
+            default: tok = UNKNOWN; break;
+        }
+    }
+    bool fail(ErrorKind k, const string& msg) { result.kind = k; result.offset = (int)(tokStart - base); result.message = msg; return false; }
+    bool closeBracket() {
+        if (tok != RBRACKET) return fail(ERR_SYNTAX, "Expected ]");
+        if (sem.inRow) { ErrorKind err = sem.closeRow(); if (err != ERR_NONE) return fail(err, sem.message); }
+        next(); return true;
+    }
+
+    // NumList -> num NumTail ; NumTail -> , NumList | eps
+    bool numList() {
+        for (;;) {
+            if (tok != NUMBER) return fail(ERR_SYNTAX, "Exp Num");
+            if (sem.inRow) sem.currentRowLength++;
+            next();
+            if (tok != COMMA) return true;
+            next();
+        }
+    }
+    // RowList -> Row RowTail ; Row -> [ NumList ] ; RowTail -> , RowList | eps
+    bool rowList() {
+        for (;;) {
+            if (tok != LBRACKET) return fail(ERR_SYNTAX, "Row needs [");
+            sem.beginRow(); next();
+            if (!numList() || !closeBracket()) return false;
+            if (tok != COMMA) return true;
+            next();
+        }
+    }
+    // M -> Core S_OPT, but S_OPT is pushed last and so expands first: an optional scalar
+    // prefix. Core -> [ Inside ] ; Inside -> RowList | NumList
+    bool matrix() {
+        if (tok == NUMBER) next();
+        if (tok != LBRACKET) return fail(ERR_SYNTAX, "Exp [");
+        next();
+        if (tok == LBRACKET) { if (!rowList()) return false; }
+        else if (tok == NUMBER) { sem.beginRow(); if (!numList()) return false; }
+        else return fail(ERR_SYNTAX, "Invalid");
+        return closeBracket();
+    }
+    bool op() {
+        if (tok != PLUS && tok != MINUS && tok != MULTIPLY) return fail(ERR_SYNTAX, "Expected OP");
+        sem.operatorSeen(*tokStart); next(); return true;
+    }
+};
+
+// simdjson-style two-stage validator with FastValidator's exact results. Stage 1 classifies the
+// input 64 bytes at a time into bitmasks (one bit per byte). Stage 2 walks only brackets, operators
+// and scalar prefixes: a row is checked and its elements counted by popcounts over the masks between
+// its '[' and ']', with a token walk only when the row holds whitespace. Anything it cannot prove
+// well-formed (syntax errors, stray bytes) is handed to FastValidator for the exact error.
+class StructuralIndexer {
+public:
+    ValidationResult validate(const char* str, size_t len) {
+        s = str; n = len;
+        if (!classify()) return FastValidator().validate(str, len);
+        sem = SemanticChecker(); result = ValidationResult();
+        size_t p = nextSig(0);
+        if (!matrix(p) || !op(p) || !matrix(p)) return result.kind != ERR_NONE ? result : FastValidator().validate(str, len);
+        if (p < n) fail(p, ERR_TRAILING, "Trailing characters found");
+        else if (sem.finish() != ERR_NONE) fail(n, ERR_DIM_MISMATCH, sem.message);
+        else { result.rows1 = sem.matrix1Rows; result.cols1 = sem.matrix1Cols; result.rows2 = sem.rows; result.cols2 = sem.expectedRowLength; }
+        return result;
+    }
+    ValidationResult validate(const string& str) { return validate(str.data(), str.size()); }
+
+private:
+    // One 64-byte block. `start` marks the first digit of each number; `inRowBad` is '[' and the
+    // operators, never legal inside a row. Bits past the end of the input are whitespace.
+    struct Block { uint64_t space, digit, start, comma, close, inRowBad; };
+    const char* s = NULL;
+    size_t n = 0;
+    vector<Block> blocks;
+    SemanticChecker sem;
+    ValidationResult result;
+
+    static uint64_t bits(uint64_t m, size_t from) { return from >= 64 ? 0 : m & (~0ULL << from); }
+    static int lowest(uint64_t m) { return __builtin_ctzll(m); }
+    static int popcount(uint64_t m) {
+#ifdef __POPCNT__
+        return __builtin_popcountll(m);
+#else   // without -mpopcnt the builtin is a libgcc call; SWAR is faster
+        m -= (m >> 1) & 0x5555555555555555ULL;
+        m = (m & 0x3333333333333333ULL) + ((m >> 2) & 0x3333333333333333ULL);
+        return (int)((((m + (m >> 4)) & 0x0F0F0F0F0F0F0F0FULL) * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+    static bool digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+    // Stage 1. Returns false if any byte is outside the grammar's alphabet.
+    bool classify() {
+        blocks.resize((n + 63) / 64);
+        uint64_t stray = 0, digitCarry = 0;
+        for (size_t k = 0; k < blocks.size(); k++) {
+            alignas(16) char buf[64];
+            const char* src = s + k * 64;
+            if (k * 64 + 64 > n) { memset(buf, ' ', 64); memcpy(buf, src, n - k * 64); src = buf; }
+            uint64_t w, d, c, l, r, o;
+            ClassifyBlock(src, w, d, c, l, r, o);
+            blocks[k] = {w, d, d & ~(d << 1 | digitCarry), c, r, l | o};
+            digitCarry = d >> 63;
+            stray |= ~(w | d | c | l | r | o);
+        }
+        return stray == 0;
+    }
+#if defined(__SSE2__) || defined(_M_X64)
+    static uint64_t lane(__m128i eq) { return (uint64_t)(unsigned)_mm_movemask_epi8(eq); }
+    static void ClassifyBlock(const char* src, uint64_t& w, uint64_t& d, uint64_t& c, uint64_t& l, uint64_t& r, uint64_t& o) {
+        w = d = c = l = r = o = 0;
+        for (int i = 0; i < 4; i++) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + 16 * i));
+            auto is = [&](char ch) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch)); };
+            // Unsigned range checks: x - lo <= span  <=>  min(x - lo, span) == x - lo
+            __m128i dv = _mm_sub_epi8(v, _mm_set1_epi8('0')), tv = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+            __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(dv, _mm_set1_epi8(9)), dv);
+            __m128i space = _mm_or_si128(is(' '), _mm_cmpeq_epi8(_mm_min_epu8(tv, _mm_set1_epi8(4)), tv));
+            int sh = 16 * i;
+            w |= lane(space) << sh; d |= lane(digit) << sh; c |= lane(is(',')) << sh;
+            l |= lane(is('[')) << sh; r |= lane(is(']')) << sh;
+            o |= lane(_mm_or_si128(_mm_or_si128(is('+'), is('-')), is('*'))) << sh;
+        }
+    }
+#else
+    static void ClassifyBlock(const char* src, uint64_t& w, uint64_t& d, uint64_t& c, uint64_t& l, uint64_t& r, uint64_t& o) {
+        w = d = c = l = r = o = 0;
+        for (int i = 0; i < 64; i++) {
+            unsigned char ch = src[i]; uint64_t bit = 1ULL << i;
+            if (ch == ' ' || (unsigned char)(ch - '\t') < 5) w |= bit; else if ((unsigned char)(ch - '0') < 10) d |= bit;
+            else if (ch == ',') c |= bit; else if (ch == '[') l |= bit; else if (ch == ']') r |= bit;
+            else if (ch == '+' || ch == '-' || ch == '*') o |= bit;
+        }
+    }
+#endif
+
+    // First position >= i whose bit in `field` is set (or clear, with flip); n if none.
+    size_t next(uint64_t Block::*field, size_t i, bool flip = false) const {
+        for (size_t k = i / 64; k < blocks.size(); k++) {
+            uint64_t b = bits(flip ? ~(blocks[k].*field) : blocks[k].*field, k == i / 64 ? i % 64 : 0);
+            if (b) return min(n, k * 64 + lowest(b));
+        }
+        return n;
+    }
+    size_t nextSig(size_t i) const { return next(&Block::space, i, true); }
+    size_t numberEnd(size_t i) const { return next(&Block::digit, i, true); }
+
+    bool fail(size_t at, ErrorKind k, const string& msg) { result.kind = k; result.offset = (int)at; result.message = msg; return false; }
+    // Row content starting at `a`, up to the next ']' (returned in r). Gives the element count, or
+    // -1 unless the bytes between are exactly "num (, num)*" with optional whitespace.
+    int rowLength(size_t a, size_t& r) const {
+        uint64_t bad = 0, spaces = 0; int nums = 0, commas = 0;
+        r = n;
+        for (size_t k = a / 64; k < blocks.size(); k++) {
+            const Block& b = blocks[k];
+            uint64_t m = bits(~0ULL, k == a / 64 ? a % 64 : 0), close = b.close & m;
+            if (close) { r = k * 64 + lowest(close); m &= (close & -close) - 1; }
+            bad |= b.inRowBad & m; spaces |= b.space & m; nums += popcount(b.start & m); commas += popcount(b.comma & m);
+            if (close) break;
+        }
+        if (r >= n || bad) return -1;
+        // Digits and commas only: runs of digits alternate with single commas iff there is
+        // one comma fewer than numbers and the row starts and ends on a digit.
+        if (!spaces) return r > a && digit(s[a]) && digit(s[r - 1]) && commas == nums - 1 ? nums : -1;
+        int elements = 0;
+        for (size_t p = nextSig(a); ; ) {
+            if (p >= r || !digit(s[p])) return -1;
+            elements++;
+            p = nextSig(numberEnd(p));
+            if (p == r) return elements;
+            if (s[p] != ',') return -1;
+            p = nextSig(p + 1);
+        }
+    }
+    // Checks the row starting at a and reports its ']' in r.
+    bool row(size_t a, size_t& r) {
+        int k = rowLength(a, r);
+        if (k < 0) return false;
+        sem.beginRow(); sem.currentRowLength = k;
+        ErrorKind err = sem.closeRow();
+        return err == ERR_NONE || fail(r, err, sem.message);
+    }
+    // [num] "[" ( "[" row "]" ("," "[" row "]")* | row ) "]", leaving p on the next significant byte.
+    bool matrix(size_t& p) {
+        if (p < n && digit(s[p])) p = nextSig(numberEnd(p));
+        if (p >= n || s[p] != '[') return false;
+        p = nextSig(p + 1);
+        size_t r;
+        if (p < n && s[p] == '[') {
+            for (;;) {
+                if (!row(p + 1, r)) return false;
+                p = nextSig(r + 1);
+                if (p >= n || s[p] != ',') break;
+                p = nextSig(p + 1);
+                if (p >= n || s[p] != '[') return false;
+            }
+            if (p >= n || s[p] != ']') return false;
+        } else {
+            if (!row(p, r)) return false;
+            p = r;
+        }
+        p = nextSig(p + 1);
+        return true;
+    }
+    bool op(size_t& p) {
+        if (p >= n || (s[p] != '+' && s[p] != '-' && s[p] != '*')) return false;
+        sem.operatorSeen(s[p]); p = nextSig(p + 1); return true;
+    }
+};
+
+// A wrong-shaped request is rejected in one allocation-free pass over the input, before the PDA
+// stores any value; a well-shaped one gets exactly sized operand buffers.
+template<class Trace> void BasicParserEngine<Trace>::inferShapes() {
+    reservedSize[0] = reservedSize[1] = 0;
+    if (!earlyShapeCheck || recoverErrors || !BuiltinRules(grammar)) return;
+    thread_local StructuralIndexer indexer;   // keeps its block buffer between runs
+    ValidationResult pre = indexer.validate(lexer.input);
+    if (pre.ok()) {
+        reservedSize[0] = (size_t)pre.rows1 * pre.cols1; reservedSize[1] = (size_t)pre.rows2 * pre.cols2;
+        if constexpr (traced) addLog(TRACE_FULL, "Shapes: ", pre.rows1, "x", pre.cols1, ", ", pre.rows2, "x", pre.cols2);
+        return;
+    }
+    if (pre.kind == ERR_SYNTAX || pre.kind == ERR_TRAILING) return; // the PDA reports those itself
+    while (tokenStream[tokenCursor].offset < pre.offset) tokenCursor++;
+    triggerError("Shape check: " + pre.message, pre.kind);
+}
+
+// ==========================================
+// PART 4: EXPRESSIONS (Precedence Climbing)
+// ==========================================
+
+// Expression tree over matrix literals. Leaves are parsed by the PDA (start symbol M), so each
+// operand gets the same 1x1 and row checks; binary nodes apply the Matrix 1 vs Matrix 2 check.
+struct ExprNode {
+    char op = 0;            // 0 for a literal leaf, else '+', '-' or '*'
+    int lhs = -1, rhs = -1; // child indices into ExprParser::nodes
+    int rows = 0, cols = 0, offset = 0;
+    Matrix value;           // leaves only
+};
+
+class ExprParser {
+public:
+    vector<ExprNode> nodes;
+    int root = -1;
+    ErrorKind errorKind = ERR_NONE;
+    int errorOffset = -1;
+    string message;
+
+    bool parse(const string& input) {
+        Lexer lx; lx.init(input); toks = lx.tokenizeAll();
+        nodes.clear(); root = -1; cur = 0; errorKind = ERR_NONE; errorOffset = -1; message = "";
+        if (!BuiltinRules(activeGrammar)) { message = "Expressions are off: the loaded grammar is not the built-in one"; return false; }
+        root = parseExpr(1);
+        if (root >= 0 && toks[cur].type != END_TOKEN) { fail(ERR_TRAILING, "Trailing characters found"); root = -1; }
+        return root >= 0;
+    }
+    string describe(int n) const {
+        const ExprNode& e = nodes[n];
+        if (!e.op) return "[" + to_string(e.rows) + "x" + to_string(e.cols) + "]";
+        return "(" + describe(e.lhs) + " " + e.op + " " + describe(e.rhs) + ")";
+    }
+
+private:
+    vector<Token> toks;
+    size_t cur = 0;
+    ParseOnlyEngine literal;
+
+    static int precedence(TokenType t) { return (t == PLUS || t == MINUS) ? 1 : (t == MULTIPLY ? 2 : 0); }
+    int fail(ErrorKind k, const string& msg, int offset = -1) {
+        errorKind = k; errorOffset = offset >= 0 ? offset : toks[cur].offset; message = msg;
+        return -1;
+    }
+
+    // Binary operators are left-associative: the right side only takes tighter-binding operators.
+    int parseExpr(int minPrec) {
+        int lhs = parsePrimary();
+        while (lhs >= 0 && precedence(toks[cur].type) >= minPrec) {
+            Token opTok = toks[cur++];
+            int rhs = parseExpr(precedence(opTok.type) + 1);
+            if (rhs < 0) return -1;
+            lhs = combine(opTok, lhs, rhs);
+        }
+        return lhs;
+    }
+    int combine(const Token& opTok, int lhs, int rhs) {
+        ExprNode n; n.op = opTok.value[0]; n.lhs = lhs; n.rhs = rhs; n.offset = opTok.offset;
+        const ExprNode &a = nodes[lhs], &b = nodes[rhs];
+        string msg;
+        if (CheckShapes(n.op, a.rows, a.cols, b.rows, b.cols, msg) != ERR_NONE) return fail(ERR_DIM_MISMATCH, msg, opTok.offset);
+        n.rows = a.rows; n.cols = b.cols;
+        nodes.push_back(n);
+        return (int)nodes.size() - 1;
+    }
+    int parsePrimary() {
+        if (toks[cur].type == LPAREN) {
+            cur++;
+            int e = parseExpr(1);
+            if (e < 0) return -1;
+            if (toks[cur].type != RPAREN) return fail(ERR_SYNTAX, "Expected )");
+            cur++;
+            return e;
+        }
+        if (toks[cur].type != LBRACKET && toks[cur].type != NUMBER) return fail(ERR_SYNTAX, "Expected operand");
+        // Literal extent: optional scalar prefix, then up to the matching ']'. The PDA judges the contents.
+        size_t start = cur;
+        if (toks[cur].type == NUMBER) cur++;
+        if (toks[cur].type == LBRACKET) {
+            for (int depth = 0; toks[cur].type != END_TOKEN; ) {
+                TokenType t = toks[cur++].type;
+                if (t == LBRACKET) depth++;
+                else if (t == RBRACKET && --depth == 0) break;
+            }
+        }
+        vector<Token> slice(toks.begin() + start, toks.begin() + cur);
+        slice.push_back({END_TOKEN, "EOF", toks[cur].offset});
+        literal.grammar = &LL1;  // the loaded grammar has the same rules (checked in parse)
+        literal.resetTokens(slice, SYM_M); literal.run();
+        if (literal.isLocked) return fail(literal.errorKind, literal.errors[0].message, literal.errorOffset);
+        ExprNode n; n.offset = toks[start].offset; n.value = literal.operands[0];
+        n.rows = n.value.rows; n.cols = n.value.cols;
+        nodes.push_back(n);
+        return (int)nodes.size() - 1;
+    }
+};
+
+// ==========================================
+// PART 5: LALR(1) ENGINE (Bottom-Up)
+// ==========================================
+
+// Built once from the constexpr Grammar: canonical LR(1) item sets merged by core. Stored compressed,
+// bison-style: each state keeps a sparse action row plus a default reduction, and each
+// nonterminal keeps a sparse goto column plus a default target.
+class LALRTables {
+public:
+    enum { ACT_ERROR = 0, ACT_SHIFT = 1, ACT_REDUCE = 2, ACT_ACCEPT = 3 };
+    static int kindOf(int act) { return act & 3; }
+    static int targetOf(int act) { return act >> 2; }
+
+    vector<string> symbols;          // terminals [0, numTerminals), then nonterminals; 0 is "$"
+    int numTerminals = 0, numStates = 0, conflicts = 0;
+    vector<int> prodLhs, prodLen;    // production 0 is the augmented S' -> S
+    vector<string> prodText;
+    vector<int> actionStart, actionSym, actionVal, defaultAction;
+    vector<int> gotoStart, gotoFrom, gotoTo, defaultGoto;
+    vector<bool> acceptState;        // states where only "$" may follow
+
+    // One table set per grammar, built on first use.
+    // Built once per grammar and shared; any thread may ask (engines look their tables up in reset()).
+    static const LALRTables& get(const LL1Table* g = &LL1) {
+        static mutex m;
+        static map<const LL1Table*, LALRTables> built;   // entries never move or go away, so references stay valid unlocked
+        lock_guard<mutex> lk(m);
+        auto it = built.find(g);
+        if (it == built.end()) it = built.emplace(g, LALRTables(*g)).first;
+        return it->second;
+    }
+    explicit LALRTables(const LL1Table& g) { build(g); }
+
+    int action(int state, int term) const {
+        for (int i = actionStart[state]; i < actionStart[state + 1]; i++) if (actionSym[i] == term) return actionVal[i];
+        return defaultAction[state];
+    }
+    int gotoState(int state, int sym) const {
+        int nt = sym - numTerminals;
+        for (int i = gotoStart[nt]; i < gotoStart[nt + 1]; i++) if (gotoFrom[i] == state) return gotoTo[i];
+        return defaultGoto[nt];
+    }
+    static int terminalFor(TokenType t) { Sym s = SymOf(t); return s == SYM_BAD ? -1 : s; }
+
+private:
+    struct Item {
+        int prod, dot, look;
+        bool operator<(const Item& o) const { return prod != o.prod ? prod < o.prod : (dot != o.dot ? dot < o.dot : look < o.look); }
+        bool operator==(const Item& o) const { return prod == o.prod && dot == o.dot && look == o.look; }
+    };
+    vector<vector<int>> prodRhs;
+    vector<unsigned> first;          // terminal bitmask per symbol
+    vector<bool> nullable;
+
+
+    int symbolIndex(const string& s) {
+        for (size_t i = 0; i < symbols.size(); i++) if (symbols[i] == s) return (int)i;
+        symbols.push_back(s); return (int)symbols.size() - 1;
+    }
+
+    vector<Item> closure(vector<Item> items) const {
+        for (size_t i = 0; i < items.size(); i++) {
+            Item it = items[i];
+            const vector<int>& rhs = prodRhs[it.prod];
+            if (it.dot >= (int)rhs.size() || rhs[it.dot] < numTerminals) continue;
+            // FIRST(beta look) for the symbols after the expanded nonterminal
+            unsigned looks = 0; bool allNullable = true;
+            for (size_t k = it.dot + 1; k < rhs.size() && allNullable; k++) { looks |= first[rhs[k]]; allNullable = nullable[rhs[k]]; }
+            if (allNullable) looks |= 1u << it.look;
+            for (size_t p = 0; p < prodRhs.size(); p++) {
+                if (prodLhs[p] != rhs[it.dot]) continue;
+                for (int b = 0; b < numTerminals; b++) {
+                    if (!(looks & (1u << b))) continue;
+                    Item n = {(int)p, 0, b};
+                    if (find(items.begin(), items.end(), n) == items.end()) items.push_back(n);
+                }
+            }
+        }
+        sort(items.begin(), items.end());
+        return items;
+    }
+
+    void build(const LL1Table& g) {
+        for (int t = 0; t < SYM_BAD; t++) symbols.push_back(g.names[t]);
+        numTerminals = (int)symbols.size();
+        string start = g.names[g.start];
+        symbolIndex(start + "'");
+        for (int p = 0; p < g.numRules; p++) symbolIndex(g.names[g.rules[p].lhs]);
+        prodLhs.push_back(symbolIndex(start + "'")); prodRhs.push_back({symbolIndex(start)}); prodText.push_back(start + "' -> " + start);
+        for (int p = 0; p < g.numRules; p++) {
+            const Rule& r = g.rules[p];
+            vector<int> rhs; string text = string(g.names[r.lhs]) + " ->";
+            for (int i = 0; i < r.len; i++) { rhs.push_back(symbolIndex(g.names[r.rhs[i]])); text += string(" ") + g.names[r.rhs[i]]; }
+            if (r.len == 0) text += " eps";
+            prodLhs.push_back(symbolIndex(g.names[r.lhs])); prodRhs.push_back(rhs); prodText.push_back(text);
+        }
+        for (const auto& r : prodRhs) prodLen.push_back((int)r.size());
+
+        // Nullable and FIRST by fixed point.
+        int n = (int)symbols.size();
+        first.assign(n, 0); nullable.assign(n, false);
+        for (int t = 0; t < numTerminals; t++) first[t] = 1u << t;
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (size_t p = 0; p < prodRhs.size(); p++) {
+                int A = prodLhs[p]; unsigned f = first[A]; bool allNullable = true;
+                for (int X : prodRhs[p]) { f |= first[X]; if (!nullable[X]) { allNullable = false; break; } }
+                if (f != first[A] || (allNullable && !nullable[A])) { first[A] = f; nullable[A] = nullable[A] || allNullable; changed = true; }
+            }
+        }
+
+        // Canonical LR(1) collection.
+        vector<vector<Item>> states; map<vector<Item>, int> index; vector<map<int, int>> trans;
+        states.push_back(closure({{0, 0, 0}})); index[states[0]] = 0; trans.push_back({});
+        for (size_t s = 0; s < states.size(); s++) {
+            for (int X = 0; X < n; X++) {
+                vector<Item> kernel;
+                for (const Item& it : states[s])
+                    if (it.dot < prodLen[it.prod] && prodRhs[it.prod][it.dot] == X) kernel.push_back({it.prod, it.dot + 1, it.look});
+                if (kernel.empty()) continue;
+                vector<Item> next = closure(kernel);
+                auto found = index.find(next);
+                int target;
+                if (found == index.end()) { target = (int)states.size(); index[next] = target; states.push_back(next); trans.push_back({}); }
+                else target = found->second;
+                trans[s][X] = target;
+            }
+        }
+
+        // Merge states with identical cores.
+        map<vector<pair<int, int>>, int> coreIndex; vector<int> lalrOf(states.size());
+        vector<vector<Item>> lalrItems;
+        for (size_t s = 0; s < states.size(); s++) {
+            vector<pair<int, int>> core;
+            for (const Item& it : states[s]) core.push_back({it.prod, it.dot});
+            core.erase(unique(core.begin(), core.end()), core.end());
+            auto found = coreIndex.find(core);
+            if (found == coreIndex.end()) { lalrOf[s] = (int)lalrItems.size(); coreIndex[core] = lalrOf[s]; lalrItems.push_back(states[s]); }
+            else { lalrOf[s] = found->second; lalrItems[found->second].insert(lalrItems[found->second].end(), states[s].begin(), states[s].end()); }
+        }
+        numStates = (int)lalrItems.size();
+
+        // Dense rows first, then compress.
+        vector<vector<int>> act(numStates, vector<int>(numTerminals, ACT_ERROR));
+        vector<vector<int>> go(n - numTerminals, vector<int>(numStates, -1));
+        acceptState.assign(numStates, false);
+        for (size_t s = 0; s < states.size(); s++)
+            for (const auto& tr : trans[s]) {
+                if (tr.first < numTerminals) act[lalrOf[s]][tr.first] = (lalrOf[tr.second] << 2) | ACT_SHIFT;
+                else go[tr.first - numTerminals][lalrOf[s]] = lalrOf[tr.second];
+            }
+        for (int s = 0; s < numStates; s++)
+            for (const Item& it : lalrItems[s]) {
+                if (it.dot < prodLen[it.prod]) continue;
+                int a = (it.prod == 0) ? ACT_ACCEPT : ((it.prod << 2) | ACT_REDUCE);
+                if (it.prod == 0) acceptState[s] = true;
+                int& cell = act[s][it.look];
+                if (cell == ACT_ERROR || cell == a) cell = a;
+                else conflicts++; // shift wins; a reduce/reduce keeps the earlier production
+            }
+
+        actionStart.push_back(0);
+        for (int s = 0; s < numStates; s++) {
+            map<int, int> reduceCount; int def = ACT_ERROR, best = 0;
+            for (int a : act[s]) if (kindOf(a) == ACT_REDUCE && ++reduceCount[a] > best) { best = reduceCount[a]; def = a; }
+            defaultAction.push_back(def);
+            for (int t = 0; t < numTerminals; t++)
+                if (act[s][t] != ACT_ERROR && act[s][t] != def) { actionSym.push_back(t); actionVal.push_back(act[s][t]); }
+            actionStart.push_back((int)actionSym.size());
+        }
+        gotoStart.push_back(0);
+        for (int nt = 0; nt < n - numTerminals; nt++) {
+            map<int, int> count; int def = -1, best = 0;
+            for (int to : go[nt]) if (to >= 0 && ++count[to] > best) { best = count[to]; def = to; }
+            defaultGoto.push_back(def);
+            for (int s = 0; s < numStates; s++)
+                if (go[nt][s] >= 0 && go[nt][s] != def) { gotoFrom.push_back(s); gotoTo.push_back(go[nt][s]); }
+            gotoStart.push_back((int)gotoFrom.size());
+        }
+    }
+};
+
+// Bottom-up twin of ParserEngine. Same lexing phase, same semantic checks (done on shifts, so a
+// rejected row is reported at its ']' exactly like the PDA), same fields for the render windows.
+class LALREngine : public FullTrace {
+public:
+    const LL1Table* grammar = activeGrammar;
+    const LALRTables* tables = NULL;   // built for `grammar`, looked up once per reset
+    bool shapeChecks = true;           // shift semantics; off unless `grammar` has the built-in rules
+    Lexer lexer;
+    vector<Token> tokenStream;
+    int tokenCursor = 0;
+    bool lexingPhase = true;
+    bool isLocked = false, isFinished = false;
+    vector<int> stateStack, symbolStack;
+
+    SemanticChecker sem;
+    int depth = 0;
+    double scalePrefix = 1;   // scalar read before the next operand's '['
+    vector<Matrix> operands;
+    vector<vector<double>> spareBuffers;
+    ErrorKind errorKind = ERR_NONE;
+    int errorOffset = -1;
+    vector<ParseError> errors;
+
+    StepTask task;
+    bool animating = true;
+
+    void reset(const string& input) {
+        tables = &LALRTables::get(grammar); shapeChecks = BuiltinRules(grammar);
+        stateStack.assign(1, 0); symbolStack.assign(1, 0);
+        lexer.init(input); tokenStream.clear(); tokenCursor = 0;
+        lexingPhase = true; isLocked = false; isFinished = false;
+        sem = SemanticChecker(); depth = 0; scalePrefix = 1; RecycleOperands(operands, spareBuffers); errorKind = ERR_NONE; errorOffset = -1; errors.clear();
+        statusMessage = "Phase 1: Lexing"; lastAction = "Init"; lastOperation = "";
+        justPushed.clear(); history.clear(); trace.seen = 0; resetBreaks(); addLog(TRACE_FULL, "Init");
+        task = body();
+    }
+    void resetTokens(const vector<Token>& tokens) {
+        reset("");
+        tokenStream = tokens; lexingPhase = false;
+        statusMessage = "Phase 2: Parsing (LALR)";
+    }
+    // Batch mode, or to the first breakpoint that fires.
+    void run() {
+        justPushed.clear(); lastOperation = ""; breakReason.clear();
+        if (isLocked || isFinished) return;
+        animating = false; task.resume(false);
+    }
+
+    void triggerError(string msg, ErrorKind kind = ERR_SYNTAX) {
+        Compose(statusMessage, "ERROR: ", msg); lastAction = "STOPPED"; isLocked = true;
+        errorKind = kind; errorOffset = tokenStream[tokenCursor].offset;
+        errors.push_back({kind, msg, tokenCursor, errorOffset});
+        addLog(TRACE_ERRORS, "ERROR: ", msg);
+    }
+    vector<string> stackView() const {
+        const LALRTables& T = *tables;
+        vector<string> v;
+        for (int i = (int)stateStack.size() - 1; i >= 0; i--) v.push_back(T.symbols[symbolStack[i]] + "  s" + to_string(stateStack[i]));
+        return v;
+    }
+    template<class... P> void addLog(TraceLevel level, const P&... act) {
+        if (!trace.keep(level)) return;
+        const LALRTables& T = *tables;
+        LogEntry& e = scratch;
+        Compose(e.action, act...);
+        // Right-recursive lists make the LR stack as deep as the longest row, so only the top is logged.
+        const size_t shown = 24;
+        size_t from = stateStack.size() > shown ? stateStack.size() - shown : 0;
+        e.stackState = from ? "... " : "";
+        for (size_t i = from; i < stateStack.size(); i++) { AppendPart(e.stackState, T.symbols[symbolStack[i]]); e.stackState += ':'; AppendPart(e.stackState, stateStack[i]); e.stackState += ' '; }
+        if (lexingPhase) e.input = "LEX"; else if (tokenCursor < (int)tokenStream.size()) e.input = tokenStream[tokenCursor].value; else e.input = "EOF";
+        record(e);
+    }
+
+    void step() {
+        justPushed.clear(); lastOperation = ""; breakReason.clear();
+        if (isLocked || isFinished) return;
+        animating = true; task.resume(true);
+    }
+
+    StepTask body() {
+        // --- PHASE 1: LEXING ---
+        if (lexingPhase) {
+            while (PumpLexer(*this, "LALR")) co_yield EV_LEX;
+            co_yield EV_LEX;
+        }
+        // --- PHASE 2: SHIFT / REDUCE ---
+        for (;;) {
+            shiftReduceStep();
+            if (isLocked || isFinished) co_return;
+            if (breaks.armed() && breakHit(tokenCursor, (int)stateStack.size(), sem.currentRowLength, errors.size(),
+                                           [&] { return tables->symbols[symbolStack.back()].c_str(); }) && !animating) {
+                addLog(TRACE_ERRORS, statusMessage); co_yield EV_BREAK; continue;
+            }
+            co_yield EV_PARSE;
+        }
+    }
+
+    void shiftReduceStep() {
+        const LALRTables& T = *tables;
+        const Token& tok = tokenStream[tokenCursor];
+        int state = stateStack.back();
+        int act = T.action(state, LALRTables::terminalFor(tok.type));
+
+        switch (LALRTables::kindOf(act)) {
+            case LALRTables::ACT_SHIFT: {
+                if (shapeChecks && !shiftSemantics(tok)) return;
+                int sym = LALRTables::terminalFor(tok.type);
+                stateStack.push_back(LALRTables::targetOf(act)); symbolStack.push_back(sym);
+                tokenCursor++;
+                Compose(lastAction, "LALR: Shift ", T.symbols[sym]); lastOperation = "SHIFT";
+                justPushed.resize(1); Compose(justPushed[0], T.symbols[sym], "  s", stateStack.back());
+                addLog(TRACE_TOKENS, "Shift ", T.symbols[sym]);
+                return;
+            }
+            case LALRTables::ACT_REDUCE: {
+                int p = LALRTables::targetOf(act);
+                stateStack.resize(stateStack.size() - T.prodLen[p]); symbolStack.resize(symbolStack.size() - T.prodLen[p]);
+                stateStack.push_back(T.gotoState(stateStack.back(), T.prodLhs[p])); symbolStack.push_back(T.prodLhs[p]);
+                Compose(lastAction, "LALR: Reduce ", T.prodText[p]); Compose(lastOperation, "REDUCE ", T.prodLen[p]);
+                justPushed.resize(1); Compose(justPushed[0], T.symbols[T.prodLhs[p]], "  s", stateStack.back());
+                addLog(TRACE_RULES, "Reduce ", T.prodText[p]);
+                return;
+            }
+            case LALRTables::ACT_ACCEPT:
+                if (sem.finish() != ERR_NONE) { triggerError(sem.message, ERR_DIM_MISMATCH); return; }
+                statusMessage = shapeChecks ? "ACCEPTED" : "ACCEPTED (syntax only)"; lastAction = "Done"; isFinished = true; addLog(TRACE_ERRORS, statusMessage);
+                for (size_t i = 0; i < operands.size(); i++) addLog(TRACE_RULES, "Operand ", i + 1, ": ", operands[i].rows, "x", operands[i].cols);
+                return;
+            default:
+                if (T.acceptState[state]) triggerError("Trailing characters found", ERR_TRAILING);
+                else triggerError("Unexpected " + tok.value);
+        }
+    }
+
+private:
+    // Depth tells row elements from the scalar prefix; the checks mirror the PDA's match actions.
+    bool shiftSemantics(const Token& tok) {
+        if (tok.type == LBRACKET) { if (depth++ == 0) { NewOperand(operands, spareBuffers); operands.back().scale = scalePrefix; scalePrefix = 1; } }
+        else if (tok.type == NUMBER && depth == 0) scalePrefix = strtod(tok.value.c_str(), NULL);
+        else if (tok.type == NUMBER) {
+            if (!sem.inRow) sem.beginRow();
+            sem.currentRowLength++;
+            double v = strtod(tok.value.c_str(), NULL);
+            operands.back().data.push_back(v); operands.back().nonzeros += v != 0;
+        }
+        else if (tok.type == RBRACKET) {
+            if (sem.inRow) {
+                int rowLength = sem.currentRowLength;
+                ErrorKind err = sem.closeRow();
+                if (err != ERR_NONE) { triggerError(sem.message, err); return false; }
+                operands.back().rows++; operands.back().cols = rowLength;
+            }
+            depth--;
+        }
+        else if (tok.type == PLUS || tok.type == MINUS || tok.type == MULTIPLY) sem.operatorSeen(tok.value[0]);
+        return true;
+    }
+};
+
+// Differential mode: every validator must agree on the verdict, the error kind and where it happened.
+bool DifferentialCheck(const string& input, string* report) {
+    ParserEngine pda; pda.earlyShapeCheck = false; pda.reset(input); pda.run();
+    LALREngine lalr; lalr.reset(input); lalr.run();
+    ParseOnlyEngine early; early.reset(input); early.run();
+    ValidationResult fast = FastValidator().validate(input);
+    if (pda.errorKind == fast.kind && pda.errorOffset == fast.offset && pda.errorKind == lalr.errorKind && pda.errorOffset == lalr.errorOffset &&
+        pda.errorKind == early.errorKind && pda.errorOffset == early.errorOffset) return true;
+    if (report) *report = "\"" + input + "\": PDA=" + ErrorKindName(pda.errorKind) + "@" + to_string(pda.errorOffset) +
+                          " LALR=" + ErrorKindName(lalr.errorKind) + "@" + to_string(lalr.errorOffset) +
+                          " early=" + ErrorKindName(early.errorKind) + "@" + to_string(early.errorOffset) +
+                          " fast=" + ErrorKindName(fast.kind) + "@" + to_string(fast.offset);
+    return false;
+}
+
+// ==========================================
+// PART 6: INCREMENTAL REPARSING
+// ==========================================
+
+// Re-validates an edited input without starting over. The PDA's state is checkpointed every
+// `checkpointEvery` tokens; after an edit only the tokens around it are re-lexed, the PDA resumes
+// from the last checkpoint before them, and it stops as soon as its state equals the old parse's
+// checkpoint at the same (shifted) token, splicing in the old outcome from there. Results match
+// a full ParseOnlyEngine run without recovery or the early shape pass.
+class IncrementalParser {
+public:
+    ParseOnlyEngine eng;
+    string text;
+    int checkpointEvery = 256;
+    int reparsedTokens = 0;          // last parse/update: tokens the PDA actually stepped over
+    bool resynced = false;           // last update: stopped early on a matching checkpoint
+    const atomic<bool>* cancel = nullptr;  // polled while stepping; when set the run is abandoned
+    bool cancelled = false;          // last parse/update was abandoned; the next update starts over
+
+    void parse(const string& input) {
+        text = input; cancelled = false;
+        Lexer lx; lx.init(input);
+        eng.earlyShapeCheck = false; eng.recoverErrors = false;
+        eng.resetTokens(lx.tokenizeAll());
+        checkpoints.clear(); checkpoints[0] = snapshot();
+        map<int, Checkpoint> none;
+        Outcome nothing;
+        drive(none, INT32_MAX, 0, 0, nothing);
+    }
+
+    void update(const string& input) {
+        if (eng.tokenStream.empty()) { parse(input); return; }
+        cancelled = false;
+        // Edited byte range: [pre, text.size() - suf) became [pre, input.size() - suf).
+        size_t pre = 0, suf = 0, shorter = min(text.size(), input.size());
+        while (pre < shorter && text[pre] == input[pre]) pre++;
+        while (suf < shorter - pre && text[text.size() - 1 - suf] == input[input.size() - 1 - suf]) suf++;
+        int newEnd = (int)(input.size() - suf), byteDelta = (int)input.size() - (int)text.size();
+        vector<Token>& old = eng.tokenStream;
+
+        // First old token the edit can touch; a number ending right at `pre` may grow.
+        int a = int(partition_point(old.begin(), old.end() - 1, [&](const Token& t) { return t.offset + (int)t.value.size() < (int)pre; }) - old.begin());
+        int from = old[a].type == END_TOKEN ? (int)pre : min((int)pre, old[a].offset);
+
+        // Re-lex one token at a time until a token past the edit lines up with an old one.
+        Lexer lx; lx.init(input, from);
+        vector<Token> fresh;
+        int j = a, resyncOld = -1;
+        for (bool more = true; more && resyncOld < 0; ) {
+            size_t n = lx.tokens.size();
+            more = lx.task.resume(true);
+            for (size_t k = n; k < lx.tokens.size(); k++) {
+                const Token& t = lx.tokens[k];
+                if (t.type != END_TOKEN && t.offset >= newEnd) {
+                    int want = t.offset - byteDelta;
+                    while (old[j].type != END_TOKEN && old[j].offset < want) j++;
+                    if (old[j].offset == want && old[j].type == t.type && old[j].value == t.value) { resyncOld = j; break; }
+                }
+                fresh.push_back(t);
+            }
+        }
+        // Splice in place: old[a, resyncOld) becomes `fresh`; the tail moves at most once.
+        bool lined = resyncOld >= 0;
+        int resyncNew = a + (int)fresh.size(), tokenDelta = resyncNew - resyncOld;
+        int removed = (lined ? resyncOld : (int)old.size()) - a, added = (int)fresh.size();
+        if (added > removed) old.insert(old.begin() + a + removed, added - removed, Token());
+        else old.erase(old.begin() + a + added, old.begin() + a + removed);
+        move(fresh.begin(), fresh.end(), old.begin() + a);
+        for (size_t k = resyncNew; k < old.size(); k++) old[k].offset += byteDelta;
+        text = input;
+
+        // An error the old parse raised before the edit only looked at unchanged tokens.
+        if (eng.isLocked && eng.tokenCursor < a) { reparsedTokens = 0; resynced = true; return; }
+
+        Outcome last = {move(eng.operands), move(eng.errors), move(eng.pdaStack), eng.isFinished, eng.isLocked,
+                        eng.errorKind, eng.errorOffset, eng.tokenCursor};
+        auto it = prev(checkpoints.upper_bound(a));   // checkpoint 0 always exists
+        const Checkpoint& cp = it->second;
+        eng.pdaStack = cp.stack; eng.sem = cp.sem; eng.operatorMatched = cp.operatorMatched;
+        eng.operands.clear();
+        for (size_t k = 0; k < cp.operands.size(); k++) {
+            Matrix m; m.rows = cp.operands[k].rows; m.cols = cp.operands[k].cols; m.scale = cp.operands[k].scale;
+            m.data.assign(last.operands[k].data.begin(), last.operands[k].data.begin() + cp.operands[k].size);
+            m.nonzeros = m.data.size() - count(m.data.begin(), m.data.end(), 0.0);
+            eng.operands.push_back(move(m));
+        }
+        eng.tokenCursor = it->first; eng.isLocked = eng.isFinished = false;
+        eng.errors.clear(); eng.errorKind = ERR_NONE; eng.errorOffset = -1;
+        map<int, Checkpoint> oldAfter;
+        for (auto o = next(it); o != checkpoints.end(); ) oldAfter.insert(checkpoints.extract(o++));
+        drive(oldAfter, lined ? resyncNew : INT32_MAX, tokenDelta, byteDelta, last);
+    }
+
+private:
+    struct OperandMark { int rows, cols; size_t size; double scale; };
+    struct Checkpoint {
+        vector<Sym> stack;
+        SemanticChecker sem;
+        bool operatorMatched;
+        vector<OperandMark> operands;
+    };
+    // The previous run's final state, replayed after a resync.
+    struct Outcome {
+        vector<Matrix> operands;
+        vector<ParseError> errors;
+        vector<Sym> stack;
+        bool finished = false, locked = false;
+        ErrorKind kind = ERR_NONE;
+        int offset = -1, cursor = 0;
+    };
+    map<int, Checkpoint> checkpoints;   // token index -> state right after matching the token before it
+
+    Checkpoint snapshot() const {
+        Checkpoint cp = {eng.pdaStack, eng.sem, eng.operatorMatched, {}};
+        for (const Matrix& m : eng.operands) cp.operands.push_back({m.rows, m.cols, m.data.size(), m.scale});
+        return cp;
+    }
+    bool sameState(const Checkpoint& cp) const {
+        const SemanticChecker& a = eng.sem; const SemanticChecker& b = cp.sem;
+        if (eng.pdaStack != cp.stack || eng.operatorMatched != cp.operatorMatched || eng.operands.size() != cp.operands.size()) return false;
+        if (a.expectedRowLength != b.expectedRowLength || a.currentRowLength != b.currentRowLength || a.inRow != b.inRow ||
+            a.rows != b.rows || a.op != b.op || a.matrix1Rows != b.matrix1Rows || a.matrix1Cols != b.matrix1Cols ||
+            a.poisoned != b.poisoned || a.partial != b.partial || a.scaleNext != b.scaleNext) return false;
+        for (size_t k = 0; k < cp.operands.size(); k++)
+            if (eng.operands[k].rows != cp.operands[k].rows || eng.operands[k].cols != cp.operands[k].cols) return false;
+        return true;
+    }
+
+    // Steps the PDA to the end, checkpointing on the way. From token `resyncNew` on, the input is
+    // the old one shifted by `tokenDelta`, so a state equal to the old checkpoint there means the
+    // rest of the run would repeat `last`; that outcome is spliced in instead.
+    void drive(map<int, Checkpoint>& oldAfter, int resyncNew, int tokenDelta, int byteDelta, Outcome& last) {
+        int start = eng.tokenCursor;
+        resynced = false;
+        for (int steps = 0; !eng.isLocked && !eng.isFinished; steps++) {
+            if (cancel && (steps & 1023) == 0 && cancel->load(memory_order_relaxed)) { cancelled = true; eng.tokenStream.clear(); return; }
+            int before = eng.tokenCursor;
+            eng.parseStep();
+            int i = eng.tokenCursor;
+            if (i == before) continue;
+            if (i >= resyncNew) {
+                auto o = oldAfter.find(i - tokenDelta);
+                if (o != oldAfter.end() && sameState(o->second)) {
+                    reparsedTokens = i - start;
+                    splice(o->second, oldAfter, o->first, tokenDelta, byteDelta, last);
+                    return;
+                }
+            }
+            if (i % checkpointEvery == 0) checkpoints[i] = snapshot();
+        }
+        reparsedTokens = eng.tokenCursor - start;
+    }
+
+    void splice(const Checkpoint& at, map<int, Checkpoint>& oldAfter, int oldIndex, int tokenDelta, int byteDelta, Outcome& last) {
+        for (size_t k = 0; k < last.operands.size(); k++) {
+            if (k >= eng.operands.size()) { eng.operands.push_back(move(last.operands[k])); continue; }
+            Matrix& m = eng.operands[k];
+            m.data.insert(m.data.end(), last.operands[k].data.begin() + at.operands[k].size, last.operands[k].data.end());
+            m.nonzeros = m.data.size() - count(m.data.begin(), m.data.end(), 0.0);
+            m.rows = last.operands[k].rows; m.cols = last.operands[k].cols;
+        }
+        // Operands begun before the resync may have had their scalar prefix edited; later ones have not.
+        for (auto o = oldAfter.find(oldIndex); o != oldAfter.end(); ) {
+            auto node = oldAfter.extract(o++);
+            node.key() += tokenDelta;
+            vector<OperandMark>& marks = node.mapped().operands;
+            for (size_t k = 0; k < marks.size() && k < eng.operands.size(); k++) marks[k].scale = eng.operands[k].scale;
+            checkpoints.insert(move(node));
+        }
+        eng.pdaStack = move(last.stack); eng.isFinished = last.finished; eng.isLocked = last.locked;
+        eng.errorKind = last.kind; eng.errorOffset = last.offset < 0 ? -1 : last.offset + byteDelta;
+        eng.errors = move(last.errors);
+        for (ParseError& e : eng.errors) { e.tokenIndex += tokenDelta; if (e.offset >= 0) e.offset += byteDelta; }
+        eng.tokenCursor = last.cursor + tokenDelta;
+        resynced = true;
+    }
+};
+
+// ==========================================
+// PART 7: LIVE VALIDATION
+// ==========================================
+
+// Re-validates the input box on a worker thread once typing pauses for `debounceMs`. A newer
+// edit cancels the run in flight. The frame loop only hands over text and copies the last
+// finished verdict under a short lock, so it never waits on a parse.
+class LiveValidator {
+public:
+    struct Verdict {
+        bool ready = false, accepted = false;
+        ErrorKind kind = ERR_NONE;
+        int offset = -1;
+        string message, shapes;
+    };
+    int debounceMs = 20;
+    atomic<int> cancelledRuns{0};
+
+    ~LiveValidator() { stop(); }
+    void start() {
+        inc.eng.grammar = activeGrammar; inc.cancel = &cancel;
+        worker = thread([this] { run(); });
+    }
+    void stop() {
+        { lock_guard<mutex> lk(m); quit = true; cancel = true; }
+        cv.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+    // Called every frame; does nothing unless the text changed since the last call.
+    void submit(const char* input) {
+        lock_guard<mutex> lk(m);
+        if (pending == input) return;
+        pending = input; submitted++;
+        due = chrono::steady_clock::now() + chrono::milliseconds(debounceMs);
+        cancel = true;
+        cv.notify_one();
+    }
+    Verdict latest() { lock_guard<mutex> lk(m); return verdict; }
+    bool stale() { lock_guard<mutex> lk(m); return finished != submitted; }
+
+private:
+    IncrementalParser inc;   // worker-only
+    thread worker;
+    mutex m; condition_variable cv;
+    // Guarded by m.
+    string pending;
+    unsigned submitted = 0, finished = 0;
+    chrono::steady_clock::time_point due;
+    bool quit = false;
+    Verdict verdict;
+    atomic<bool> cancel{false};
+
+    void run() {
+        unique_lock<mutex> lk(m);
+        while (!quit) {
+            if (finished == submitted) { cv.wait(lk); continue; }
+            if (chrono::steady_clock::now() < due) { cv.wait_until(lk, due); continue; }
+            string text = pending; unsigned gen = submitted;
+            cancel = false;
+            lk.unlock();
+            inc.update(text);
+            Verdict v = inc.cancelled ? Verdict() : judge();
+            lk.lock();
+            if (inc.cancelled) { cancelledRuns++; continue; }
+            verdict = move(v); finished = gen;
+        }
+    }
+    Verdict judge() const {
+        const ParseOnlyEngine& e = inc.eng;
+        Verdict v; v.ready = true;
+        v.accepted = e.isFinished && e.errors.empty();
+        if (!e.errors.empty()) { v.kind = e.errors[0].kind; v.offset = e.errors[0].offset; v.message = e.errors[0].message; }
+        for (const Matrix& op : e.operands) v.shapes += (v.shapes.empty() ? "" : ", ") + ShapeText(op.rows, op.cols);
+        return v;
+    }
+};
+
+// ==========================================
+// PART 8: RUN CACHE
+// ==========================================
+
+// Finished runs of a stepping engine, keyed by a hash of the input and of every setting that changes
+// the run. Loading a seen input copies the whole finished engine back (tokens, verdict, operands,
+// trace) instead of re-running it. Least recently used entries go first once `capacity` is reached.
+template<class E> class RunCache {
+public:
+    size_t capacity = 16;
+    int hits = 0, misses = 0;
+
+    // "Reset / Load": restore the finished run for `input`, or reset and remember to store it later.
+    // True if the run was restored.
+    bool load(E& eng, const string& input) {
+        uint64_t key = keyOf(eng, input);
+        auto it = index.find(key);
+        if (it == index.end() || it->second->second.lexer.input != input) {
+            misses++; eng.reset(input); pending = key; return false;
+        }
+        runs.splice(runs.begin(), runs, it->second);
+        Breakpoints breaks = eng.breaks; TraceWriter* sink = eng.sink;   // the user's, not the cached run's
+        vector<vector<double>> spare = move(eng.spareBuffers);
+        eng = it->second->second; eng.breaks = breaks; eng.sink = sink; eng.spareBuffers = move(spare);
+        hits++; pending = 0;
+        return true;
+    }
+    // After a step or run: keep the run once it has finished.
+    void store(const E& eng) {
+        if (!pending || (!eng.isFinished && !eng.isLocked)) return;
+        if (index.count(pending)) runs.erase(index[pending]);
+        runs.emplace_front(pending, eng); index[pending] = runs.begin();
+        runs.front().second.spareBuffers.clear();
+        pending = 0;
+        while (runs.size() > capacity) { index.erase(runs.back().first); runs.pop_back(); }
+    }
+    size_t size() const { return runs.size(); }
+
+private:
+    list<pair<uint64_t, E>> runs;                       // most recently used first
+    map<uint64_t, typename list<pair<uint64_t, E>>::iterator> index;
+    uint64_t pending = 0;                               // key of the run in progress, 0 if none
+
+    static uint64_t keyOf(const E& eng, const string& input) {
+        string settings = to_string(eng.trace.level) + "/" + to_string(eng.trace.sampleEvery);
+        if constexpr (requires { eng.recoverErrors; }) settings += string(eng.recoverErrors ? "R" : "r") + (eng.earlyShapeCheck ? "E" : "e");
+        return Fnv1a(settings, Fnv1a(input)) ^ (uint64_t)(uintptr_t)eng.grammar;
+    }
+};
+
+// ==========================================
+// PART 9: EVALUATION
+// ==========================================
+
+// Element-wise kernels, one per instruction set. The best one the CPU supports is picked at startup
+// and --isa can force another. z = c[0]*x[0] + ... + c[count-1]*x[count-1] covers +, -, the operands'
+// scalar prefixes and whole fused chains (A + B - C in one pass). A result bigger than the
+// last-level cache is written with non-temporal stores, which skip the read for ownership and
+// leave the cache to the operands still being read.
+enum SimdIsa { ISA_SCALAR, ISA_SSE2, ISA_AVX2, ISA_AVX512, NUM_ISAS };
+const char* IsaNames[NUM_ISAS] = {"scalar", "sse2", "avx2", "avx512"};
+using CombineKernel = void (*)(size_t n, int count, const double* c, const double* const* x, double* z, bool stream);
+
+inline double CombineAt(size_t i, int count, const double* c, const double* const* x) {
+    double s = c[0] * x[0][i];
+    for (int j = 1; j < count; j++) s += c[j] * x[j][i];
+    return s;
+}
+// Blocks small enough for L1, so the compiler can vectorize each operand's pass over a block.
+void CombineScalar(size_t n, int count, const double* c, const double* const* x, double* z, bool) {
+    for (size_t b = 0; b < n; b += 512) {
+        size_t e = min(n, b + 512);
+        for (size_t i = b; i < e; i++) z[i] = c[0] * x[0][i];
+        for (int j = 1; j < count; j++) for (size_t i = b; i < e; i++) z[i] += c[j] * x[j][i];
+    }
+}
+#if defined(__SSE2__) || defined(_M_X64)
+inline __m128d CombineSSE2At(size_t i, int count, const double* c, const double* const* x) {
+    __m128d v = _mm_mul_pd(_mm_set1_pd(c[0]), _mm_loadu_pd(x[0] + i));
+    for (int j = 1; j < count; j++) v = _mm_add_pd(v, _mm_mul_pd(_mm_set1_pd(c[j]), _mm_loadu_pd(x[j] + i)));
+    return v;
+}
+void CombineSSE2(size_t n, int count, const double* c, const double* const* x, double* z, bool stream) {
+    size_t i = 0;
+    if (stream) {
+        for (; i < n && ((uintptr_t)(z + i) & 15); i++) z[i] = CombineAt(i, count, c, x);
+        for (; i + 2 <= n; i += 2) _mm_stream_pd(z + i, CombineSSE2At(i, count, c, x));
+        _mm_sfence();
+    }
+    else for (; i + 2 <= n; i += 2) _mm_storeu_pd(z + i, CombineSSE2At(i, count, c, x));
+    for (; i < n; i++) z[i] = CombineAt(i, count, c, x);
+}
+#endif
+#ifdef SIMD_DISPATCH
+__attribute__((target("avx2"))) inline __m256d CombineAVX2At(size_t i, int count, const double* c, const double* const* x) {
+    __m256d v = _mm256_mul_pd(_mm256_set1_pd(c[0]), _mm256_loadu_pd(x[0] + i));
+    for (int j = 1; j < count; j++) v = _mm256_add_pd(v, _mm256_mul_pd(_mm256_set1_pd(c[j]), _mm256_loadu_pd(x[j] + i)));
+    return v;
+}
+__attribute__((target("avx2"))) void CombineAVX2(size_t n, int count, const double* c, const double* const* x, double* z, bool stream) {
+    size_t i = 0;
+    if (stream) {
+        for (; i < n && ((uintptr_t)(z + i) & 31); i++) z[i] = CombineAt(i, count, c, x);
+        for (; i + 4 <= n; i += 4) _mm256_stream_pd(z + i, CombineAVX2At(i, count, c, x));
+        _mm_sfence();
+    }
+    else for (; i + 4 <= n; i += 4) _mm256_storeu_pd(z + i, CombineAVX2At(i, count, c, x));
+    for (; i < n; i++) z[i] = CombineAt(i, count, c, x);
+}
+__attribute__((target("avx512f"))) inline __m512d CombineAVX512At(size_t i, int count, const double* c, const double* const* x) {
+    __m512d v = _mm512_mul_pd(_mm512_set1_pd(c[0]), _mm512_loadu_pd(x[0] + i));
+    for (int j = 1; j < count; j++) v = _mm512_add_pd(v, _mm512_mul_pd(_mm512_set1_pd(c[j]), _mm512_loadu_pd(x[j] + i)));
+    return v;
+}
+__attribute__((target("avx512f"))) void CombineAVX512(size_t n, int count, const double* c, const double* const* x, double* z, bool stream) {
+    size_t i = 0;
+    if (stream) {
+        for (; i < n && ((uintptr_t)(z + i) & 63); i++) z[i] = CombineAt(i, count, c, x);
+        for (; i + 8 <= n; i += 8) _mm512_stream_pd(z + i, CombineAVX512At(i, count, c, x));
+        _mm_sfence();
+    }
+    else for (; i + 8 <= n; i += 8) _mm512_storeu_pd(z + i, CombineAVX512At(i, count, c, x));
+    for (; i < n; i++) z[i] = CombineAt(i, count, c, x);
+}
+#endif
+
+bool IsaSupported(SimdIsa isa) {
+    switch (isa) {
+        case ISA_SCALAR: return true;
+#if defined(__SSE2__) || defined(_M_X64)
+        case ISA_SSE2: return true;
+#endif
+#ifdef SIMD_DISPATCH
+        case ISA_AVX2: return __builtin_cpu_supports("avx2");
+        case ISA_AVX512: return __builtin_cpu_supports("avx512f");
+#endif
+        default: return false;
+    }
+}
+CombineKernel CombineFor(SimdIsa isa) {
+    switch (isa) {
+#if defined(__SSE2__) || defined(_M_X64)
+        case ISA_SSE2: return CombineSSE2;
+#endif
+#ifdef SIMD_DISPATCH
+        case ISA_AVX2: return CombineAVX2;
+        case ISA_AVX512: return CombineAVX512;
+#endif
+        default: return CombineScalar;
+    }
+}
+
+// Size of the largest data cache, or 8 MB when the OS does not say.
+size_t LastLevelCacheBytes() {
+    size_t best = LargestCacheBytes();
+    return best ? best : (size_t)8 << 20;
+}
+
+struct ElementKernels {
+    SimdIsa isa = ISA_SCALAR;
+    CombineKernel combine = CombineScalar;
+    size_t streamBytes = (size_t)8 << 20;   // results at least this big use non-temporal stores
+    // The best supported ISA up to `limit`.
+    void select(SimdIsa limit) {
+        isa = ISA_SCALAR;
+        for (int i = 0; i <= limit && i < NUM_ISAS; i++) if (IsaSupported((SimdIsa)i)) isa = (SimdIsa)i;
+        combine = CombineFor(isa);
+    }
+    void combineInto(size_t n, int count, const double* c, const double* const* x, double* z) const {
+        combine(n, count, c, x, z, n * sizeof(double) >= streamBytes);
+    }
+};
+ElementKernels elementKernels;
+
+// Fork-join pool for independent tasks. run() deals the task ids out to one deque per worker in
+// contiguous blocks. A worker pops its own deque from the back and, once that is empty, steals from
+// the front of the others, so uneven tiles still finish together. The calling thread is worker 0.
+class WorkStealingPool {
 public:
-    string input;
-    int pos;
-    AnimMode mode = MODE_NONE;
-    NFAState nfaState = S_NONE;
-    NFAState nfaTarget = S_NONE;
-    int nfaStep = 0; 
-    DFAState dfaState = D_NONE;
-    int dfaIdx = 0;
-    string currentNumBuild = "";
-    Token readyToken = {NONE_TOKEN, ""}; 
-    bool finished = false;
+    atomic<long long> steals{0};
 
-    void init(string s) { 
-        input = s; pos = 0; mode = MODE_NONE; 
-        readyToken = {NONE_TOKEN, ""}; 
-        finished = false;
+    ~WorkStealingPool() { resize(1); }
+    int size() const { return (int)queues.size(); }
+    void resize(int n) {
+        { lock_guard<mutex> lk(m); quit = true; }
+        wake.notify_all();
+        for (thread& t : threads) t.join();
+        threads.clear(); quit = false;
+        queues.clear();
+        for (int i = 0; i < max(1, n); i++) queues.push_back(make_unique<Queue>());
+        for (int i = 1; i < max(1, n); i++) threads.emplace_back([this, i] { loop(i); });
     }
-    
-    char peek(int offset = 0) { if (pos + offset >= input.length()) return 0; return input[pos + offset]; }
-
-    bool step() {
-        if (readyToken.type != NONE_TOKEN) return false; 
-        if (finished) return false;
-        
-        if (mode == MODE_NONE) {
-            char c = peek();
-            while (pos < input.length() && isspace(input[pos])) { pos++; c = peek(); }
-            if (pos >= input.length()) { readyToken = {END_TOKEN, "EOF"}; finished = true; return false; }
-            
-            if (isdigit(c)) { 
-                mode = MODE_NFA; nfaState = S0; nfaStep = 0; currentNumBuild = ""; return true; 
-            }
-            pos++;
-            if (c == '[') readyToken = {LBRACKET, "["};
-            else if (c == ']') readyToken = {RBRACKET, "]"};
-            else if (c == ',') readyToken = {COMMA, ","};
-            else if (c == '+') readyToken = {PLUS, "+"};
-            else if (c == '-') readyToken = {MINUS, "-"};
-            else if (c == '*') readyToken = {MULTIPLY, "*"};
-            else readyToken = {UNKNOWN, string(1, c)};
-            return false;
+    // fn(task, worker) for every task in [0, count); returns once all of them are done.
+    void run(int count, const function<void(int, int)>& fn) {
+        int n = size();
+        if (n <= 1 || count <= 1) { for (int t = 0; t < count; t++) fn(t, 0); return; }
+        job = &fn; remaining = count;
+        for (int w = 0; w < n; w++) {
+            lock_guard<mutex> lk(queues[w]->m);
+            for (int t = (int)((long long)count * w / n); t < (long long)count * (w + 1) / n; t++) queues[w]->tasks.push_back(t);
         }
+        { lock_guard<mutex> lk(m); generation++; }
+        wake.notify_all();
+        work(0);
+        unique_lock<mutex> lk(m);
+        idle.wait(lk, [&] { return busy == 0 && remaining.load() == 0; });
+    }
 
-        if (mode == MODE_NFA) {
-            char c = peek();
-            switch (nfaStep) {
-                case 0: nfaState = S0; nfaTarget = S1; currentNumBuild += c; pos++; nfaStep = 1; break;
-                case 1: nfaState = S1; nfaTarget = S2; nfaStep = 2; break;
-                case 2: nfaState = S2; if (isdigit(peek())) { nfaTarget = S3; nfaStep = 3; } else { nfaTarget = S_FINAL; nfaStep = 5; } break;
-                case 3: nfaState = S3; nfaTarget = S4; currentNumBuild += peek(); pos++; nfaStep = 4; break;
-                case 4: nfaState = S4; nfaTarget = S2; nfaStep = 2; break;
-                case 5: nfaState = S_FINAL; nfaTarget = S_NONE; mode = MODE_DFA; dfaState = D_START; dfaIdx = 0; return true;
-            }
-            return true;
-        }
+private:
+    struct Queue { mutex m; deque<int> tasks; };
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> threads;
+    mutex m;
+    condition_variable wake, idle;
+    const function<void(int, int)>* job = NULL;
+    atomic<int> remaining{0};
+    uint64_t generation = 0;
+    int busy = 0;              // workers inside work()
+    bool quit = false;
 
-        if (mode == MODE_DFA) {
-            if (dfaIdx <= currentNumBuild.length()) {
-                if (dfaState == D_START) {
-                    if (dfaIdx < currentNumBuild.length()) { dfaState = D_ACCEPT; dfaIdx++; return true; }
-                }
-                else if (dfaState == D_ACCEPT) {
-                    if (dfaIdx < currentNumBuild.length()) { dfaIdx++; return true; }
-                    else { mode = MODE_NONE; dfaState = D_NONE; readyToken = {NUMBER, currentNumBuild}; return false; }
-                }
-            }
+    bool next(int self, int& task) {
+        { Queue& q = *queues[self]; lock_guard<mutex> lk(q.m); if (!q.tasks.empty()) { task = q.tasks.back(); q.tasks.pop_back(); return true; } }
+        for (int k = 1; k < size(); k++) {
+            Queue& q = *queues[(self + k) % size()];
+            lock_guard<mutex> lk(q.m);
+            if (!q.tasks.empty()) { task = q.tasks.front(); q.tasks.pop_front(); steals++; return true; }
         }
         return false;
     }
+    void work(int self) { for (int t; next(self, t); ) { (*job)(t, self); remaining--; } }
+    void loop(int self) {
+        for (uint64_t seen = 0;;) {
+            { unique_lock<mutex> lk(m); wake.wait(lk, [&] { return quit || generation != seen; }); if (quit) return; seen = generation; busy++; }
+            work(self);
+            { lock_guard<mutex> lk(m); if (--busy == 0) idle.notify_all(); }
+        }
+    }
 };
 
-// ==========================================
-// PART 2: PDA
-// ==========================================
+// Computes an accepted expression from the parsed operands. + and - are one pass over both
+// operands. * is a blocked GEMM in the Goto/BLIS layout. C is cut into MC x NT output tiles,
+// which run in parallel on `pool` when one is set. For each KC-deep slice a tile packs its
+// part of B into NR-wide column slivers and its part of A into MR-high row slivers. An MR x NR
+// micro-kernel then keeps its block of C in registers while it streams both slivers from cache.
+constexpr int GEMM_MR = 4, GEMM_NR = 4, GEMM_KC = 256, GEMM_MC = 128, GEMM_NT = 256;
+// Strassen-Winograd for big products: each level does 7 half-size multiplies instead of 8, plus
+// 15 additions. It recurses while every half is still at least the cutover (tuned with
+// --bench-eval), then hands over to the blocked GEMM. It rounds differently from the classic
+// product, so "exact" only takes it when all intermediates are integers below 2^53. Then both
+// are exact and the results are identical. "always" takes it for any operands.
+enum StrassenMode { STRASSEN_OFF, STRASSEN_EXACT, STRASSEN_ALWAYS, NUM_STRASSEN_MODES };
+const char* StrassenModeNames[NUM_STRASSEN_MODES] = {"off", "exact", "always"};
+constexpr int STRASSEN_CUTOVER = 128;
+// A factor of a product that is at least this fraction zeros is multiplied in compressed sparse rows
+// (CSR), where the work scales with the non-zeros. Measured with --bench-eval at 1024x1024: sparse *
+// dense takes 71 ms in CSR against 369 ms dense at 90% zeros, and 204 against 292 at 70%; sparse *
+// sparse 100 against 246 ms at 90%, break-even near 70%. Sums of literals stay dense. Compressing a
+// literal means reading all of it, and that alone made CSR sums 2-5x slower than the fused kernel at
+// every density (17.9 ms against 3.7 at 90% zeros, 5.9 against 2.6 at 99.9%). A sparse product stays
+// in CSR, so a sum of sparse products is still added sparse (A*B + B*A: 221 against 554 ms at 90%).
+constexpr double SPARSE_ZERO_RATIO = 0.8;
 
-struct LogEntry { string input, action, stackState; };
+// Dense -> CSR, keeping the scale; columns come out sorted within each row.
+void CompressRows(const Matrix& d, Matrix& s) {
+    s.rows = d.rows; s.cols = d.cols; s.scale = d.scale; s.data.clear();
+    s.rowStart.assign(1, 0); s.colIndex.clear(); s.values.clear();
+    for (int i = 0; i < d.rows; i++) {
+        const double* row = d.data.data() + (size_t)i * d.cols;
+        for (int j = 0; j < d.cols; j++) if (row[j] != 0) { s.colIndex.push_back(j); s.values.push_back(row[j]); }
+        s.rowStart.push_back((int)s.values.size());
+    }
+    s.nonzeros = s.values.size();
+}
+// CSR -> dense, in place.
+void ExpandRows(Matrix& m) {
+    if (!m.sparse()) return;
+    m.data.assign((size_t)m.rows * m.cols, 0.0);
+    for (int i = 0; i < m.rows; i++)
+        for (int p = m.rowStart[i]; p < m.rowStart[i + 1]; p++) m.data[(size_t)i * m.cols + m.colIndex[p]] = m.values[p];
+    m.rowStart.clear(); m.colIndex.clear(); m.values.clear();
+}
 
-class ParserEngine {
+class MatrixEvaluator {
 public:
-    stack<string> pdaStack;
-    Lexer lexer;
-    vector<Token> tokenStream;
-    int tokenCursor = 0;
-    bool lexingPhase = true; 
-    bool isLocked = false, isFinished = false;
-    
-    int expectedRowLength = -1, currentRowLength = 0;
-    bool inRow = false;
-    int matrix1Cols = -1; 
-    
-    string statusMessage, lastAction, lastOperation = ""; 
-    vector<string> justPushed; 
-    vector<LogEntry> history; 
+    // out = a op b, each operand times its scalar prefix. The parser has already checked the shapes.
+    // Factors of * the parser counted as mostly zeros are switched to CSR first; the result is always dense.
+    void evaluate(char op, const Matrix& a, const Matrix& b, Matrix& out) {
+        strassenLevels = sparseOperands = 0; flops = 0; temps.clear();
+        if (op == '*') apply(op, compressed(a), compressed(b), out);
+        else apply(op, a, b, out);
+        ExpandRows(out);
+    }
 
-    void reset(string input) {
-        while(!pdaStack.empty()) pdaStack.pop();
-        pdaStack.push("$"); pdaStack.push("S");
-        lexer.init(input); tokenStream.clear(); tokenCursor = 0;
-        lexingPhase = true; isLocked = false; isFinished = false;
-        expectedRowLength = -1; currentRowLength = 0; inRow = false; matrix1Cols = -1; 
-        statusMessage = "Phase 1: Lexing"; lastAction = "Init"; lastOperation = "";
-        justPushed.clear(); history.clear(); addLog("Init");
+    // Value of expression-tree node `n`. A maximal run of + and - is one fused pass: it is flattened
+    // into coefficient * operand terms and every output element is computed once from all of them,
+    // written straight into `out`. Only a * inside a run, or a run feeding a *, gets a temporary.
+    // A maximal run of * is a matrix chain: it is multiplied in the order the classic O(n^3)
+    // dynamic program finds cheapest for the factors' shapes, whatever parenthesization was written.
+    // Factors past the zero ratio are multiplied in CSR and a sparse product stays in CSR, so a sum of
+    // sparse products is added sparse.
+    int fusedOperands = 0, temporaries = 0;   // largest fused pass and temporaries of the last call
+    int sparseOperands = 0;                   // factors and results held in CSR during the last call
+    double flops = 0;                         // floating-point operations of the last call
+    double sparseZeroRatio = SPARSE_ZERO_RATIO;   // above 1: never use CSR
+    bool reorderChains = true;
+    vector<LogEntry> plan;                    // one entry per chain of 3 or more factors
+    void evaluate(const vector<ExprNode>& nodes, int n, Matrix& out) {
+        fusedOperands = temporaries = strassenLevels = sparseOperands = 0; flops = 0; temps.clear(); plan.clear();
+        evaluateNode(nodes, n, out);
+        ExpandRows(out);
+    }
+
+    WorkStealingPool* pool = NULL;   // NULL: multiply on the calling thread
+    StrassenMode strassen = STRASSEN_EXACT;
+    int strassenCutover = STRASSEN_CUTOVER;
+    int strassenLevels = 0;          // deepest Strassen-Winograd recursion of the last call, 0 if none
+
+    // C (m x n) += alpha * A (m x k) * B (k x n); row-major, contiguous.
+    void multiply(int m, int n, int k, double alpha, const double* A, const double* B, double* C) { multiply(m, n, k, alpha, A, k, B, n, C, n); }
+    // The same on blocks of bigger matrices, with row strides lda, ldb and ldc.
+    void multiply(int m, int n, int k, double alpha, const double* A, int lda, const double* B, int ldb, double* C, int ldc) {
+        int tilesN = (n + GEMM_NT - 1) / GEMM_NT, tiles = (m + GEMM_MC - 1) / GEMM_MC * tilesN;
+        int workers = pool ? pool->size() : 1;
+        if ((int)buffers.size() < workers) buffers.resize(workers);
+        auto tile = [&](int t, int w) {
+            int ic = t / tilesN * GEMM_MC, jc = t % tilesN * GEMM_NT;
+            multiplyTile(buffers[w], min(GEMM_MC, m - ic), min(GEMM_NT, n - jc), k, alpha, A + (size_t)ic * lda, lda, B + jc, ldb, C + (size_t)ic * ldc + jc, ldc);
+        };
+        if (pool) pool->run(tiles, tile);
+        else for (int t = 0; t < tiles; t++) tile(t, 0);
     }
 
-    void triggerError(string msg) { statusMessage = "ERROR: " + msg; lastAction = "STOPPED"; isLocked = true; addLog("ERROR: " + msg); }
-    void pushStack(vector<string> items) {
-        lastOperation = "PUSH " + to_string(items.size()); justPushed = items;
-        for (const string& s : items) pdaStack.push(s);
-        addLog("PUSH " + to_string(items.size()) + " Rules");
+    // Levels of Strassen-Winograd an m x k by k x n product gets: halving while every side stays at least the cutover.
+    int strassenDepth(int m, int n, int k) const {
+        int levels = 0;
+        if (strassen != STRASSEN_OFF && strassenCutover > 0)
+            while ((min(m, min(n, k)) >> levels) >= 2 * strassenCutover) levels++;
+        return levels;
     }
-    void addLog(string act) {
-        string s = "";
-        if (pdaStack.empty()) s = "empty";
-        else {
-            stack<string> t = pdaStack; vector<string> v;
-            while(!t.empty()){ v.push_back(t.top()); t.pop(); }
-            for(int i=v.size()-1; i>=0; i--) s += v[i] + " ";
+    // C = alpha * A * B by Strassen-Winograd with `levels` levels. The workspace is sized once up
+    // front and each level carves its three half-size blocks from it, so the recursion never allocates.
+    void strassenMultiply(int levels, int m, int n, int k, double alpha, const double* A, int lda, const double* B, int ldb, double* C, int ldc) {
+        size_t need = 0;
+        for (int l = 1, mm = m, nn = n, kk = k; l <= levels; l++) {
+            mm /= 2; nn /= 2; kk /= 2;
+            need += (size_t)mm * kk + (size_t)kk * nn + (size_t)mm * nn;
         }
-        string inStr = (lexingPhase) ? "LEX" : (tokenCursor < tokenStream.size() ? tokenStream[tokenCursor].value : "EOF");
-        history.push_back({inStr, act, s});
+        if (workspace.size() < need) workspace.resize(need);
+        winograd(levels, m, n, k, alpha, A, lda, B, ldb, C, ldc, workspace.data());
     }
 
-    void step() {
-        justPushed.clear(); lastOperation = "";
-        if (isLocked || isFinished) return;
-        
-        // --- PHASE 1: LEXING ---
-        if (lexingPhase) {
-            if (lexer.readyToken.type != NONE_TOKEN) {
-                tokenStream.push_back(lexer.readyToken);
-                lastAction = "Lexer: Generated " + lexer.readyToken.value;
-                addLog("Token: " + lexer.readyToken.value);
-                if (lexer.readyToken.type == END_TOKEN) {
-                    lexingPhase = false; 
-                    statusMessage = "Phase 2: Parsing (PDA)";
-                    lastAction = "Lexing Done. Starting PDA.";
-                }
-                lexer.readyToken = {NONE_TOKEN, ""}; 
-                return;
+private:
+    vector<double> workspace;   // Strassen-Winograd blocks, kept between calls
+    struct Term { int node; double coef; const Matrix* value; };
+
+    void apply(char op, const Matrix& a, const Matrix& b, Matrix& out) {
+        out.scale = 1; out.rowStart.clear();
+        if (a.sparse() || b.sparse()) {
+            if (op != '*') {
+                Term t[2] = {{-1, 1, &a}, {-1, op == '-' ? -1.0 : 1.0, &b}};
+                sumTerms(t, 2, a.rows, a.cols, out);
             }
-            bool busy = lexer.step();
-            if (busy) {
-                if (lexer.mode == MODE_NFA) lastAction = "Lexer: 1. NFA Running...";
-                else if (lexer.mode == MODE_DFA) lastAction = "Lexer: 2. DFA Verifying...";
-            } 
+            else if (a.sparse() && b.sparse()) sparseProduct(a, b, out);
+            else sparseDenseProduct(a, b, out);
             return;
         }
+        if (op == '*') {
+            flops += 2.0 * a.rows * a.cols * b.cols;
+            out.rows = a.rows; out.cols = b.cols; out.data.assign((size_t)a.rows * b.cols, 0.0);
+            double alpha = a.scale * b.scale;
+            int levels = strassenDepth(a.rows, b.cols, a.cols);
+            if (levels && (strassen == STRASSEN_ALWAYS || exactUnder(a, b, alpha, levels))) {
+                strassenMultiply(levels, a.rows, b.cols, a.cols, alpha, a.data.data(), a.cols, b.data.data(), b.cols, out.data.data(), out.cols);
+                strassenLevels = max(strassenLevels, levels);
+            }
+            else multiply(a.rows, b.cols, a.cols, alpha, a.data.data(), b.data.data(), out.data.data());
+            return;
+        }
+        out.rows = a.rows; out.cols = a.cols; out.data.resize(a.data.size());
+        double c[2] = {a.scale, op == '-' ? -b.scale : b.scale};
+        const double* x[2] = {a.data.data(), b.data.data()};
+        elementKernels.combineInto(a.data.size(), 2, c, x, out.data.data());
+        flops += 2.0 * out.data.size();
+    }
 
-        // --- PHASE 2: PARSING ---
-        if (pdaStack.empty()) return;
-        string top = pdaStack.top();
-        Token currentToken = tokenStream[tokenCursor];
-
-        if (top == "$") {
-            if (currentToken.type == END_TOKEN) { 
-                statusMessage = "ACCEPTED"; lastAction = "Done"; isFinished = true; pdaStack.pop(); addLog("ACCEPTED"); return; 
-            } else { triggerError("Trailing characters found"); return; }
-        }
-
-        bool isTerminal = (top == "[" || top == "]" || top == "," || top == "+" || top == "-" || top == "*" || top == "num");
-        
-        if (isTerminal) {
-            bool match = false;
-            if (top == "[" && currentToken.type == LBRACKET) match = true;
-            else if (top == "]" && currentToken.type == RBRACKET) match = true;
-            else if (top == "," && currentToken.type == COMMA) match = true;
-            else if (top == "+" && currentToken.type == PLUS) match = true;
-            else if (top == "-" && currentToken.type == MINUS) match = true;
-            else if (top == "*" && currentToken.type == MULTIPLY) match = true;
-            else if (top == "num" && currentToken.type == NUMBER) match = true;
-
-            if (match) {
-                // --- STRICT SEMANTIC CHECKS ---
-                if (top == "num" && inRow) {
-                    currentRowLength++;
-                }
-                else if (top == "]" && inRow) {
-                    // Check 1: Minimum Size (1x1 not allowed)
-                    if (currentRowLength < 2) {
-                         triggerError("Invalid Matrix: 1x1 not allowed");
-                         return;
-                    }
-
-                    // Check 2: Matrix 2 vs Matrix 1
-                    if (matrix1Cols != -1) {
-                         if (currentRowLength != matrix1Cols) {
-                             triggerError("Dimension Mismatch! Matrix 1=" + to_string(matrix1Cols) + ", Matrix 2=" + to_string(currentRowLength));
-                             return;
-                         }
-                    }
+    // The parser's non-zero count decides: a matrix with enough zeros gets a CSR copy in `temps`.
+    const Matrix& compressed(const Matrix& m) {
+        if (m.sparse() || m.nonzeros < 0 || m.data.empty() || (double)m.nonzeros > (1 - sparseZeroRatio) * m.data.size()) return m;
+        Matrix& s = temps.emplace_back();
+        CompressRows(m, s); sparseOperands++;
+        return s;
+    }
+    // A CSR result that came out denser than the threshold is expanded again.
+    void settle(Matrix& m) {
+        m.nonzeros = m.values.size();
+        if ((double)m.nonzeros > (1 - sparseZeroRatio) * m.rows * m.cols) ExpandRows(m);
+        else sparseOperands++;
+    }
 
-                    // Check 3: Row Consistency
-                    if (expectedRowLength == -1) { 
-                        expectedRowLength = currentRowLength; 
-                        addLog("Set Dim: " + to_string(expectedRowLength)); 
-                    } 
-                    else {
-                        if (currentRowLength != expectedRowLength) { 
-                            triggerError("Row Mismatch! Exp " + to_string(expectedRowLength) + ", Got " + to_string(currentRowLength)); 
-                            return; 
-                        }
+    // Sum of coef * value over the terms when at least one is in CSR. With a dense term the result is
+    // dense: the dense terms go through the fused kernel and the sparse ones are scattered on top.
+    // With none it is built row by row in CSR through a dense accumulator row (a sparse accumulator).
+    void sumTerms(const Term* t, int count, int rows, int cols, Matrix& out) {
+        out.rows = rows; out.cols = cols; out.scale = 1;
+        size_t at = coefs.size();
+        for (int i = 0; i < count; i++)
+            if (!t[i].value->sparse()) { coefs.push_back(t[i].coef * t[i].value->scale); sources.push_back(t[i].value->data.data()); }
+        int dense = (int)(coefs.size() - at);
+        if (dense) {
+            out.rowStart.clear(); out.data.resize((size_t)rows * cols);
+            elementKernels.combineInto(out.data.size(), dense, &coefs[at], &sources[at], out.data.data());
+            flops += 2.0 * (dense - 1) * out.data.size();
+            for (int i = 0; i < count; i++) {
+                const Matrix& m = *t[i].value;
+                if (!m.sparse()) continue;
+                double c = t[i].coef * m.scale;
+                for (int r = 0; r < rows; r++)
+                    for (int p = m.rowStart[r]; p < m.rowStart[r + 1]; p++) out.data[(size_t)r * cols + m.colIndex[p]] += c * m.values[p];
+                flops += 2.0 * m.values.size();
+            }
+            coefs.resize(at); sources.resize(at);
+            return;
+        }
+        out.data.clear(); out.rowStart.assign(1, 0); out.colIndex.clear(); out.values.clear();
+        startAccumulator(cols);
+        for (int r = 0; r < rows; r++) {
+            for (int i = 0; i < count; i++) {
+                const Matrix& m = *t[i].value;
+                double c = t[i].coef * m.scale;
+                for (int p = m.rowStart[r]; p < m.rowStart[r + 1]; p++) accumulate(r, m.colIndex[p], c * m.values[p]);
+                flops += 2.0 * (m.rowStart[r + 1] - m.rowStart[r]);
+            }
+            emitRow(out);
+        }
+        settle(out);
+    }
+    // Gustavson's row-by-row SpMM: row i of the product is the sum of B's rows picked out by A's
+    // non-zeros in row i, gathered in the sparse accumulator. Work is the number of products formed.
+    void sparseProduct(const Matrix& a, const Matrix& b, Matrix& out) {
+        double alpha = a.scale * b.scale;
+        out.rows = a.rows; out.cols = b.cols; out.scale = 1;
+        out.data.clear(); out.rowStart.assign(1, 0); out.colIndex.clear(); out.values.clear();
+        startAccumulator(b.cols);
+        for (int i = 0; i < a.rows; i++) {
+            for (int p = a.rowStart[i]; p < a.rowStart[i + 1]; p++) {
+                int k = a.colIndex[p]; double v = alpha * a.values[p];
+                for (int q = b.rowStart[k]; q < b.rowStart[k + 1]; q++) accumulate(i, b.colIndex[q], v * b.values[q]);
+                flops += 2.0 * (b.rowStart[k + 1] - b.rowStart[k]);
+            }
+            emitRow(out);
+        }
+        settle(out);
+    }
+    // One side in CSR, the other dense; the result is dense. Sparse A: each non-zero A[i][k] adds a
+    // multiple of B's row k to C's row i. Sparse B: each non-zero A[i][k] adds a multiple of B's
+    // sparse row k. Rows of C are independent, so blocks of them run on the pool.
+    void sparseDenseProduct(const Matrix& a, const Matrix& b, Matrix& out) {
+        double alpha = a.scale * b.scale;
+        int n = b.cols, blocks = (a.rows + 31) / 32;
+        out.rows = a.rows; out.cols = n; out.scale = 1; out.rowStart.clear();
+        out.data.assign((size_t)a.rows * n, 0.0);
+        auto rowBlock = [&](int t, int) {
+            for (int i = t * 32; i < min(a.rows, t * 32 + 32); i++) {
+                double* c = out.data.data() + (size_t)i * n;
+                if (a.sparse())
+                    for (int p = a.rowStart[i]; p < a.rowStart[i + 1]; p++) {
+                        double coef[2] = {1, alpha * a.values[p]};
+                        const double* x[2] = {c, b.data.data() + (size_t)a.colIndex[p] * n};
+                        elementKernels.combine(n, 2, coef, x, c, false);   // c += v * B's row, vectorized
                     }
-                    
-                    currentRowLength = 0; inRow = false;
-                }
-                else if (top == "+" || top == "-" || top == "*") { 
-                    if (expectedRowLength != -1) {
-                        matrix1Cols = expectedRowLength;
-                        addLog("Locked Matrix 1 Dim: " + to_string(matrix1Cols));
+                else
+                    for (int k = 0; k < a.cols; k++) {
+                        double v = a.data[(size_t)i * a.cols + k];
+                        if (v == 0) continue;
+                        v *= alpha;
+                        for (int q = b.rowStart[k]; q < b.rowStart[k + 1]; q++) c[b.colIndex[q]] += v * b.values[q];
                     }
-                    expectedRowLength = -1; currentRowLength = 0; inRow = false; 
+            }
+        };
+        if (pool) pool->run(blocks, rowBlock);
+        else for (int t = 0; t < blocks; t++) rowBlock(t, 0);
+        flops += a.sparse() ? 2.0 * a.values.size() * n : 2.0 * a.rows * b.values.size();
+    }
+
+    // Sparse accumulator: a dense row of sums plus the list of columns touched in the current row.
+    vector<double> accum;
+    vector<int> accumRow, touched;
+    void startAccumulator(int cols) { accum.resize(cols); accumRow.assign(cols, -1); touched.clear(); }
+    void accumulate(int row, int col, double v) {
+        if (accumRow[col] != row) { accumRow[col] = row; accum[col] = 0; touched.push_back(col); }
+        accum[col] += v;
+    }
+    void emitRow(Matrix& out) {
+        sort(touched.begin(), touched.end());
+        for (int j : touched) if (accum[j] != 0) { out.colIndex.push_back(j); out.values.push_back(accum[j]); }
+        out.rowStart.push_back((int)out.values.size());
+        touched.clear();
+    }
+
+    vector<Term> terms;        // used as a stack: each fused pass owns the entries it pushed
+    vector<double> coefs;
+    vector<const double*> sources;
+    deque<Matrix> temps;       // products inside sums, and sums under products; stable addresses
+
+    void evaluateNode(const vector<ExprNode>& nodes, int n, Matrix& out) {
+        const ExprNode& e = nodes[n];
+        if (e.op == '*') { evaluateChain(nodes, n, out); return; }
+        size_t base = terms.size();
+        flatten(nodes, n, 1.0);
+        size_t end = terms.size();
+        bool anySparse = false;
+        for (size_t i = base; i < end; i++) {
+            if (!terms[i].value) { Matrix& t = temps.emplace_back(); temporaries++; evaluateNode(nodes, terms[i].node, t); terms[i].value = &t; }
+            anySparse |= terms[i].value->sparse();
+        }
+        fusedOperands = max(fusedOperands, (int)(end - base));
+        if (anySparse) { sumTerms(&terms[base], (int)(end - base), e.rows, e.cols, out); terms.resize(base); return; }
+        coefs.resize(end); sources.resize(end);
+        for (size_t i = base; i < end; i++) { coefs[i] = terms[i].coef * terms[i].value->scale; sources[i] = terms[i].value->data.data(); }
+        out.rows = e.rows; out.cols = e.cols; out.scale = 1; out.rowStart.clear(); out.data.resize((size_t)e.rows * e.cols);
+        elementKernels.combineInto(out.data.size(), (int)(end - base), &coefs[base], &sources[base], out.data.data());
+        if (end - base > 1) flops += 2.0 * (end - base - 1) * out.data.size();
+        terms.resize(base);
+    }
+    // Leaves are used in place; a * below the run is evaluated after flattening (value still NULL).
+    void flatten(const vector<ExprNode>& nodes, int n, double sign) {
+        const ExprNode& e = nodes[n];
+        if (e.op == '+' || e.op == '-') { flatten(nodes, e.lhs, sign); flatten(nodes, e.rhs, e.op == '-' ? -sign : sign); return; }
+        terms.push_back({n, sign, e.op ? NULL : &e.value});
+    }
+    const Matrix& operand(const vector<ExprNode>& nodes, int n) {
+        if (!nodes[n].op) return compressed(nodes[n].value);
+        Matrix& t = temps.emplace_back(); temporaries++;
+        evaluateNode(nodes, n, t);
+        return t;
+    }
+
+    // Chain A1 * ... * An with Ai of shape dims[i-1] x dims[i]: cost[i][j] is the cheapest way to
+    // form Ai..Aj and split[i][j] the last multiply of it.
+    struct Chain {
+        vector<int> factors;                 // node indices, left to right
+        vector<const Matrix*> values;
+        vector<int> dims;
+        vector<double> cost;                 // count x count, row-major
+        vector<int> split;
+        int count() const { return (int)factors.size(); }
+    };
+    static void collectFactors(const vector<ExprNode>& nodes, int n, vector<int>& out) {
+        if (nodes[n].op == '*') { collectFactors(nodes, nodes[n].lhs, out); collectFactors(nodes, nodes[n].rhs, out); }
+        else out.push_back(n);
+    }
+    // FLOPs of the * nodes as the expression was written.
+    static double writtenCost(const vector<ExprNode>& nodes, int n) {
+        const ExprNode& e = nodes[n];
+        if (e.op != '*') return 0;
+        return writtenCost(nodes, e.lhs) + writtenCost(nodes, e.rhs) + 2.0 * e.rows * nodes[e.lhs].cols * e.cols;
+    }
+    void evaluateChain(const vector<ExprNode>& nodes, int n, Matrix& out) {
+        Chain c;
+        collectFactors(nodes, n, c.factors);
+        int k = c.count();
+        for (int f : c.factors) c.values.push_back(&operand(nodes, f));
+        c.dims.push_back(nodes[c.factors[0]].rows);
+        for (int f : c.factors) c.dims.push_back(nodes[f].cols);
+        c.cost.assign((size_t)k * k, 0); c.split.assign((size_t)k * k, 0);
+        for (int len = 2; len <= k; len++)
+            for (int i = 0; i + len - 1 < k; i++) {
+                int j = i + len - 1;
+                double& best = c.cost[i * k + j]; best = -1;
+                // Last split first, so ties keep the written left-to-right order; without reordering it is the only one.
+                for (int s = j - 1; s >= i; s--) {
+                    if (!reorderChains && s != j - 1) continue;
+                    double cand = c.cost[i * k + s] + c.cost[(s + 1) * k + j] + 2.0 * c.dims[i] * c.dims[s + 1] * c.dims[j + 1];
+                    if (best < 0 || cand < best) { best = cand; c.split[i * k + j] = s; }
                 }
-                
-                lastAction = "PDA: Matched " + top; lastOperation = "POP & MATCH";
-                pdaStack.pop(); tokenCursor++; addLog("Match " + top);
-            } else { triggerError("Expected " + top); }
-        } else {
-            pdaStack.pop();
-            if (top == "S") { pushStack({"M", "OP", "M"}); }
-            else if (top == "OP") {
-                if (currentToken.type == PLUS) pushStack({"+"});
-                else if (currentToken.type == MINUS) pushStack({ "-"});
-                else if (currentToken.type == MULTIPLY) pushStack({"*"});
-                else triggerError("Expected OP");
-            }
-            else if (top == "M") { pushStack({"Core", "S_OPT"}); }
-            else if (top == "S_OPT") { if (currentToken.type == NUMBER) pushStack({"num"}); else addLog("Epsilon"); }
-            else if (top == "Core") { if (currentToken.type == LBRACKET) { pushStack({"]", "Inside", "["}); } else triggerError("Exp ["); }
-            else if (top == "Inside") { 
-                if (currentToken.type == LBRACKET) pushStack({"RowList"}); 
-                else if (currentToken.type == NUMBER) {
-                    pushStack({"NumList"}); 
-                    // FIX: START COUNTING FOR 1D MATRICES TOO!
-                    inRow = true; 
-                    currentRowLength = 0; 
-                } 
-                else triggerError("Invalid"); 
-            }
-            else if (top == "RowList") { pushStack({"RowTail", "Row"}); }
-            else if (top == "Row") { 
-                if (currentToken.type == LBRACKET) { 
-                    pushStack({"]", "NumList", "["}); 
-                    inRow = true; 
-                    currentRowLength = 0; 
-                } else triggerError("Row needs ["); 
-            }
-            else if (top == "RowTail") { if (currentToken.type == COMMA) { pushStack({"RowList", ","}); } else addLog("Epsilon"); }
-            else if (top == "NumList") { if (currentToken.type == NUMBER) { pushStack({"NumTail", "num"}); } else triggerError("Exp Num"); }
-            else if (top == "NumTail") { if (currentToken.type == COMMA) { pushStack({"NumList", ","}); } else addLog("Epsilon"); }
+            }
+        if (k >= 3) {
+            double written = writtenCost(nodes, n), chosen = c.cost[k - 1];
+            char cost[96];
+            snprintf(cost, sizeof(cost), ": %.3g FLOP, %.3g as written (%.1fx)", chosen, written, chosen > 0 ? written / chosen : 1.0);
+            plan.push_back({"EVAL", "Chain of " + to_string(k) + (reorderChains ? " reordered" : " left to right"), orderText(c, 0, k - 1) + cost});
+        }
+        product(c, 0, k - 1, &out);
+    }
+    const Matrix& product(const Chain& c, int i, int j, Matrix* out) {
+        if (i == j) return *c.values[i];
+        int s = c.split[i * c.count() + j];
+        const Matrix &a = product(c, i, s, NULL), &b = product(c, s + 1, j, NULL);
+        Matrix& dst = out ? *out : temps.emplace_back();
+        if (!out) temporaries++;
+        apply('*', a, b, dst);
+        return dst;
+    }
+    string orderText(const Chain& c, int i, int j) const {
+        if (i == j) return "[" + to_string(c.dims[i]) + "x" + to_string(c.dims[i + 1]) + "]";
+        int s = c.split[i * c.count() + j];
+        return "(" + orderText(c, i, s) + " * " + orderText(c, s + 1, j) + ")";
+    }
+
+    // True when Strassen-Winograd gives exactly the classic product: integer entries and scale, and
+    // every value stays below 2^53. Per level the sums grow each side at most 4x and each output
+    // adds up at most 4 products, hence 64x a level on top of the classic bound.
+    static bool exactUnder(const Matrix& a, const Matrix& b, double alpha, int levels) {
+        double ma = 0, mb = 0;
+        for (double v : a.data) { if (v != floor(v)) return false; ma = max(ma, fabs(v)); }
+        for (double v : b.data) { if (v != floor(v)) return false; mb = max(mb, fabs(v)); }
+        return alpha == floor(alpha) && ma * mb * fabs(alpha) * a.cols * ldexp(1.0, 6 * levels) < 0x1p53;
+    }
+    // z = cx * x + cy * y on an m x n block, one row at a time through the element-wise kernel. z may be x, never y.
+    static void blockSum(int m, int n, double* z, int ldz, double cx, const double* x, int ldx, double cy, const double* y, int ldy) {
+        double c[2] = {cx, cy};
+        for (int i = 0; i < m; i++) {
+            const double* src[2] = {x + (size_t)i * ldx, y + (size_t)i * ldy};
+            elementKernels.combineInto(n, 2, c, src, z + (size_t)i * ldz);
+        }
+    }
+    // One level on the even part, with X = S, Y = T and Z = P1 as the only temporaries; the other six
+    // products and all of the U sums are formed in C's own quadrants. An odd row, column or inner
+    // index is peeled off and finished with the classic kernel.
+    void winograd(int level, int m, int n, int k, double alpha, const double* A, int lda, const double* B, int ldb, double* C, int ldc, double* w) {
+        if (level == 0) {
+            for (int i = 0; i < m; i++) fill(C + (size_t)i * ldc, C + (size_t)i * ldc + n, 0.0);
+            multiply(m, n, k, alpha, A, lda, B, ldb, C, ldc);
+            return;
+        }
+        int m2 = m / 2, n2 = n / 2, k2 = k / 2;
+        const double *A11 = A, *A12 = A + k2, *A21 = A + (size_t)m2 * lda, *A22 = A21 + k2;
+        const double *B11 = B, *B12 = B + n2, *B21 = B + (size_t)k2 * ldb, *B22 = B21 + n2;
+        double *C11 = C, *C12 = C + n2, *C21 = C + (size_t)m2 * ldc, *C22 = C21 + n2;
+        double *X = w, *Y = X + (size_t)m2 * k2, *Z = Y + (size_t)k2 * n2, *rest = Z + (size_t)m2 * n2;
+        blockSum(m2, k2, X, k2, 1, A11, lda, -1, A21, lda);                      // S3
+        blockSum(k2, n2, Y, n2, 1, B22, ldb, -1, B12, ldb);                      // T3
+        winograd(level - 1, m2, n2, k2, alpha, X, k2, Y, n2, C21, ldc, rest);    // C21 = P7
+        blockSum(m2, k2, X, k2, 1, A21, lda, 1, A22, lda);                       // S1
+        blockSum(k2, n2, Y, n2, 1, B12, ldb, -1, B11, ldb);                      // T1
+        winograd(level - 1, m2, n2, k2, alpha, X, k2, Y, n2, C22, ldc, rest);    // C22 = P5
+        blockSum(m2, k2, X, k2, 1, X, k2, -1, A11, lda);                         // S2 = S1 - A11
+        blockSum(k2, n2, Y, n2, -1, Y, n2, 1, B22, ldb);                         // T2 = B22 - T1
+        winograd(level - 1, m2, n2, k2, alpha, X, k2, Y, n2, C12, ldc, rest);    // C12 = P6
+        blockSum(m2, k2, X, k2, -1, X, k2, 1, A12, lda);                         // S4 = A12 - S2
+        winograd(level - 1, m2, n2, k2, alpha, X, k2, B22, ldb, C11, ldc, rest); // C11 = P3
+        winograd(level - 1, m2, n2, k2, alpha, A11, lda, B11, ldb, Z, n2, rest); // Z = P1
+        blockSum(m2, n2, C12, ldc, 1, C12, ldc, 1, Z, n2);                       // U2 = P1 + P6
+        blockSum(m2, n2, C21, ldc, 1, C21, ldc, 1, C12, ldc);                    // U3 = U2 + P7
+        blockSum(m2, n2, C12, ldc, 1, C12, ldc, 1, C22, ldc);                    // U4 = U2 + P5
+        blockSum(m2, n2, C22, ldc, 1, C22, ldc, 1, C21, ldc);                    // C22 = U7 = U3 + P5
+        blockSum(m2, n2, C12, ldc, 1, C12, ldc, 1, C11, ldc);                    // C12 = U5 = U4 + P3
+        blockSum(k2, n2, Y, n2, 1, Y, n2, -1, B21, ldb);                         // T4 = T2 - B21
+        winograd(level - 1, m2, n2, k2, alpha, A22, lda, Y, n2, C11, ldc, rest); // C11 = P4
+        blockSum(m2, n2, C21, ldc, 1, C21, ldc, -1, C11, ldc);                   // C21 = U6 = U3 - P4
+        winograd(level - 1, m2, n2, k2, alpha, A12, lda, B21, ldb, C11, ldc, rest); // C11 = P2
+        blockSum(m2, n2, C11, ldc, 1, C11, ldc, 1, Z, n2);                       // C11 = U1 = P1 + P2
+        if (k % 2) multiply(2 * m2, 2 * n2, 1, alpha, A + k - 1, lda, B + (size_t)(k - 1) * ldb, ldb, C, ldc);
+        if (n % 2) {
+            for (int i = 0; i < m; i++) C[(size_t)i * ldc + n - 1] = 0;
+            multiply(m, 1, k, alpha, A, lda, B + n - 1, ldb, C + n - 1, ldc);
+        }
+        if (m % 2) {
+            fill(C + (size_t)(m - 1) * ldc, C + (size_t)(m - 1) * ldc + 2 * n2, 0.0);
+            multiply(1, 2 * n2, k, alpha, A + (size_t)(m - 1) * lda, lda, B, ldb, C + (size_t)(m - 1) * ldc, ldc);
+        }
+    }
+
+    struct Panels { vector<double> a, b; };
+    vector<Panels> buffers;   // one pair of packing buffers per worker, kept between calls
+
+    void multiplyTile(Panels& p, int mc, int nc, int k, double alpha, const double* A, int lda, const double* B, int ldb, double* C, int ldc) {
+        for (int pc = 0; pc < k; pc += GEMM_KC) {
+            int kc = min(GEMM_KC, k - pc);
+            packB(p.b, kc, nc, B + (size_t)pc * ldb, ldb);
+            packA(p.a, mc, kc, A + pc, lda);
+            for (int jr = 0; jr < nc; jr += GEMM_NR)
+                for (int ir = 0; ir < mc; ir += GEMM_MR)
+                    microKernel(kc, &p.a[(size_t)ir * kc], &p.b[(size_t)jr * kc], alpha, C + (size_t)ir * ldc + jr, ldc, min(GEMM_MR, mc - ir), min(GEMM_NR, nc - jr));
+        }
+    }
+    // Sliver by sliver, k-major inside each: A[i0 + i][p] lands at p * MR + i. Edge slivers are zero-padded.
+    static void packA(vector<double>& panelA, int mc, int kc, const double* A, int lda) {
+        panelA.resize((size_t)(mc + GEMM_MR - 1) / GEMM_MR * GEMM_MR * kc);
+        double* d = panelA.data();
+        for (int i0 = 0; i0 < mc; i0 += GEMM_MR)
+            for (int p = 0; p < kc; p++)
+                for (int i = 0; i < GEMM_MR; i++) *d++ = i0 + i < mc ? A[(size_t)(i0 + i) * lda + p] : 0.0;
+    }
+    // Same for B by columns: B[p][j0 + j] lands at p * NR + j.
+    static void packB(vector<double>& panelB, int kc, int nc, const double* B, int ldb) {
+        panelB.resize((size_t)(nc + GEMM_NR - 1) / GEMM_NR * GEMM_NR * kc);
+        double* d = panelB.data();
+        for (int j0 = 0; j0 < nc; j0 += GEMM_NR)
+            for (int p = 0; p < kc; p++) {
+                const double* row = B + (size_t)p * ldb + j0;
+                for (int j = 0; j < GEMM_NR; j++) *d++ = j0 + j < nc ? row[j] : 0.0;
+            }
+    }
+    // One MR x NR block of C. The full block is always computed (padding is zero); only the
+    // mr x nr corner that exists is written back.
+    static void microKernel(int kc, const double* a, const double* b, double alpha, double* C, int ldc, int mr, int nr) {
+        double acc[GEMM_MR][GEMM_NR];
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128d c00 = _mm_setzero_pd(), c01 = c00, c10 = c00, c11 = c00, c20 = c00, c21 = c00, c30 = c00, c31 = c00;
+        for (int p = 0; p < kc; p++, a += GEMM_MR, b += GEMM_NR) {
+            __m128d b0 = _mm_loadu_pd(b), b1 = _mm_loadu_pd(b + 2), x;
+            x = _mm_set1_pd(a[0]); c00 = _mm_add_pd(c00, _mm_mul_pd(x, b0)); c01 = _mm_add_pd(c01, _mm_mul_pd(x, b1));
+            x = _mm_set1_pd(a[1]); c10 = _mm_add_pd(c10, _mm_mul_pd(x, b0)); c11 = _mm_add_pd(c11, _mm_mul_pd(x, b1));
+            x = _mm_set1_pd(a[2]); c20 = _mm_add_pd(c20, _mm_mul_pd(x, b0)); c21 = _mm_add_pd(c21, _mm_mul_pd(x, b1));
+            x = _mm_set1_pd(a[3]); c30 = _mm_add_pd(c30, _mm_mul_pd(x, b0)); c31 = _mm_add_pd(c31, _mm_mul_pd(x, b1));
         }
+        _mm_storeu_pd(acc[0], c00); _mm_storeu_pd(acc[0] + 2, c01); _mm_storeu_pd(acc[1], c10); _mm_storeu_pd(acc[1] + 2, c11);
+        _mm_storeu_pd(acc[2], c20); _mm_storeu_pd(acc[2] + 2, c21); _mm_storeu_pd(acc[3], c30); _mm_storeu_pd(acc[3] + 2, c31);
+#else
+        for (int i = 0; i < GEMM_MR; i++) for (int j = 0; j < GEMM_NR; j++) acc[i][j] = 0;
+        for (int p = 0; p < kc; p++, a += GEMM_MR, b += GEMM_NR)
+            for (int i = 0; i < GEMM_MR; i++) for (int j = 0; j < GEMM_NR; j++) acc[i][j] += a[i] * b[j];
+#endif
+        for (int i = 0; i < mr; i++) for (int j = 0; j < nr; j++) C[(size_t)i * ldc + j] += alpha * acc[i][j];
     }
 };
 
+// The textbook loops, for checking MatrixEvaluator and as the benchmark baseline.
+void NaiveEvaluate(char op, const Matrix& a, const Matrix& b, Matrix& out) {
+    out.rows = a.rows; out.cols = b.cols; out.scale = 1;
+    out.data.assign((size_t)a.rows * b.cols, 0.0);
+    for (int i = 0; i < a.rows; i++)
+        for (int j = 0; j < b.cols; j++) {
+            size_t o = (size_t)i * b.cols + j;
+            if (op != '*') { out.data[o] = a.scale * a.data[o] + (op == '-' ? -1 : 1) * b.scale * b.data[o]; continue; }
+            for (int p = 0; p < a.cols; p++) out.data[o] += a.scale * a.data[(size_t)i * a.cols + p] * b.scale * b.data[(size_t)p * b.cols + j];
+        }
+}
+
+// Pairwise, one temporary per operator node: what fused evaluation is measured against.
+void NaiveEvaluate(const vector<ExprNode>& nodes, int n, Matrix& out) {
+    const ExprNode& e = nodes[n];
+    if (!e.op) { out = e.value; for (double& v : out.data) v *= out.scale; out.scale = 1; return; }
+    Matrix a, b;
+    NaiveEvaluate(nodes, e.lhs, a); NaiveEvaluate(nodes, e.rhs, b);
+    NaiveEvaluate(e.op, a, b, out);
+}
+
+double EvaluationFlops(char op, int m, int n, int k) { return op == '*' ? 2.0 * m * n * k : 2.0 * m * n; }
+
 ParserEngine engine;
+LALREngine lalrEngine;
+int activeEngine = 0; // 0 = LL(1) PDA, 1 = LALR(1)
+ExprParser exprParser;
 char inputBuffer[256] = "[10,20]+[30,40]"; 
+LiveValidator liveValidator;
+RunCache<ParserEngine> pdaRuns;
+RunCache<LALREngine> lalrRuns;
+TraceWriter traceRecorder;
+TraceFile traceView;
+char tracePath[256] = "trace.mtr";
+bool recordTrace = false, showTraceFile = false;
+string traceFileStatus;
+WorkStealingPool gemmPool;   // sized by --threads or the Result window, all cores by default
+int gemmThreads = 1;
+MatrixEvaluator evaluator;
+// Value of the last accepted run, computed when it finishes; cleared by "Reset / Load".
+struct Evaluation {
+    bool ready = false;
+    const char* engine = "";   // the engine whose operands were used, or "expression"
+    string expression;         // "A op B", or the expression tree
+    Matrix value;
+    double seconds = 0, flops = 0;
+    int fused = 0, temporaries = 0, strassenLevels = 0, sparseOperands = 0;
+    vector<LogEntry> plan;     // chain orders, shown at the end of the Trace Log
+} evaluation;
 
 // ==========================================
 // RENDER HELPERS
@@ -306,15 +2878,15 @@ void DrawSelfLoop(ImDrawList* dl, ImVec2 pos, ImU32 col) {
     dl->AddTriangleFilled(ImVec2(pos.x+10, pos.y-20), ImVec2(pos.x+15, pos.y-28), ImVec2(pos.x+20, pos.y-22), col);
 }
 
-void RenderNFA() {
+template<class E> void RenderNFA(const E& eng) {
     ImGui::Begin("Part 1 & 2: Lexical (NFA then DFA)", NULL);
     ImGui::Dummy(ImVec2(600, 320)); 
     ImDrawList* dl = ImGui::GetWindowDrawList();
     ImVec2 p = ImGui::GetWindowPos(); 
     float offX = p.x + 20, offY = p.y + 40;
     ImGui::SetCursorPos(ImVec2(20, 25)); ImGui::Text("1. Thompson's NFA (Creation)");
-    NFAState nS = (engine.lexer.mode == MODE_NFA) ? engine.lexer.nfaState : S_NONE;
-    NFAState nT = (engine.lexer.mode == MODE_NFA) ? engine.lexer.nfaTarget : S_NONE;
+    NFAState nS = (eng.lexer.mode == MODE_NFA) ? eng.lexer.nfaState : S_NONE;
+    NFAState nT = (eng.lexer.mode == MODE_NFA) ? eng.lexer.nfaTarget : S_NONE;
     auto NC = [&](NFAState s, NFAState d) { return (nS == s && nT == d) ? IM_COL32(255, 100, 0, 255) : IM_COL32(100, 100, 100, 255); };
     ImVec2 n0(offX+30, offY+80), n1(offX+110, offY+80), n2(offX+190, offY+80), n3(offX+270, offY+40), n4(offX+350, offY+40), nF(offX+430, offY+80);
     DrawArrow(dl, ImVec2(n0.x+20, n0.y), ImVec2(n1.x-20, n1.y), NC(S0, S1));
@@ -327,51 +2899,940 @@ void RenderNFA() {
     DrawNode(dl, n3, "3", nS==S3, false); DrawNode(dl, n4, "4", nS==S4, false); DrawNode(dl, nF, "F", nS==S_FINAL, true);
     float dOffY = offY + 140;
     ImGui::SetCursorPos(ImVec2(20, 160)); ImGui::Text("2. Optimized DFA (Verification)");
-    DFAState dS = (engine.lexer.mode == MODE_DFA) ? engine.lexer.dfaState : D_NONE;
+    DFAState dS = (eng.lexer.mode == MODE_DFA) ? eng.lexer.dfaState : D_NONE;
     ImU32 dAct = IM_COL32(255, 100, 0, 255); ImU32 dNorm = IM_COL32(100, 100, 100, 255);
     ImVec2 d0(offX+100, dOffY+50), d1(offX+300, dOffY+50);
     DrawArrow(dl, ImVec2(d0.x+20, d0.y), ImVec2(d1.x-20, d1.y), (dS == D_START) ? dAct : dNorm);
     DrawSelfLoop(dl, d1, (dS == D_ACCEPT) ? dAct : dNorm);
     DrawNode(dl, d0, "Start", dS==D_START, false); DrawNode(dl, d1, "Acc", dS==D_ACCEPT, true);
     ImGui::SetCursorPosY(300);
-    if (engine.lexer.mode == MODE_NFA) ImGui::TextColored(ImVec4(1,0.5f,0,1), "Building: %s", engine.lexer.currentNumBuild.c_str());
-    else if (engine.lexer.mode == MODE_DFA) ImGui::TextColored(ImVec4(0,0.5f,1,1), "Verifying: %s", engine.lexer.currentNumBuild.c_str());
+    if (eng.lexer.mode == MODE_NFA) ImGui::TextColored(ImVec4(1,0.5f,0,1), "Building: %s", eng.lexer.currentNumBuild.c_str());
+    else if (eng.lexer.mode == MODE_DFA) ImGui::TextColored(ImVec4(0,0.5f,1,1), "Verifying: %s", eng.lexer.currentNumBuild.c_str());
     else ImGui::TextColored(ImVec4(0,0,0,0.5f), "Lexer Idle");
     ImGui::SetCursorPosY(330); ImGui::Separator(); ImGui::Text("Generated Tokens:");
-    for (const auto& t : engine.tokenStream) { ImGui::SameLine(); ImGui::Button((t.type == NUMBER ? "NUM:" + t.value : t.value).c_str()); }
+    for (const auto& t : eng.tokenStream) { ImGui::SameLine(); ImGui::Button((t.type == NUMBER ? "NUM:" + t.value : t.value).c_str()); }
     ImGui::End();
 }
 
-void RenderPDA() {
+template<class E> void RenderPDA(const E& eng) {
     ImGui::Begin("Part 3: CFG Stack", NULL);
+    const LL1Table& G = *eng.grammar;
+    string legend = "Nonterminals:";
+    for (int i = NUM_TERMINALS; i < G.numSymbols; i++) legend += string(" ") + G.names[i];
+    ImGui::TextWrapped("%s", legend.c_str());
     ImDrawList* dl = ImGui::GetWindowDrawList();
     ImVec2 p = ImGui::GetCursorScreenPos();
     float y = p.y + 30;
-    vector<string> sv; stack<string> temp = engine.pdaStack;
-    while(!temp.empty()){ sv.push_back(temp.top()); temp.pop(); }
-    if (!engine.lastOperation.empty()) { ImGui::SetCursorPosY(ImGui::GetCursorPosY() + 5); ImGui::TextColored(ImVec4(0,0,0.8f,1), "OP: %s", engine.lastOperation.c_str()); y += 25; }
+    vector<string> sv = eng.stackView();
+    if (!eng.lastOperation.empty()) { ImGui::SetCursorPosY(ImGui::GetCursorPosY() + 5); ImGui::TextColored(ImVec4(0,0,0.8f,1), "OP: %s", eng.lastOperation.c_str()); y += 25; }
     for (const string& item : sv) {
         ImU32 boxColor = IM_COL32(230, 230, 230, 255); 
-        if (item == "[" || item == "]" || item == "," || item == "num" || item == "+" || item == "-") boxColor = IM_COL32(180, 255, 180, 255); 
-        for(const string& pushed : engine.justPushed) { if(pushed == item) { boxColor = IM_COL32(255, 255, 150, 255); break; } }
+        string sym = item.substr(0, item.find(' '));
+        int id = G.find(sym);
+        if (id > SYM_END && id < NUM_TERMINALS) boxColor = IM_COL32(180, 255, 180, 255); 
+        for(const string& pushed : eng.justPushed) { if(pushed == item) { boxColor = IM_COL32(255, 255, 150, 255); break; } }
         dl->AddRectFilled(ImVec2(p.x+10, y), ImVec2(p.x+150, y+25), boxColor); dl->AddRect(ImVec2(p.x+10, y), ImVec2(p.x+150, y+25), IM_COL32(0,0,0,255)); dl->AddText(ImVec2(p.x+20, y+5), IM_COL32(0, 0, 0, 255), item.c_str()); y += 30;
     }
     ImGui::Dummy(ImVec2(0, y - p.y + 20)); 
     ImGui::End();
 }
 
-void RenderTrace() {
+template<class E> void RenderTrace(E& eng) {
     ImGui::Begin("Trace Log", NULL);
+    int level = eng.trace.level;
+    ImGui::SetNextItemWidth(90); if (ImGui::Combo("Verbosity", &level, TraceLevelNames, 4)) eng.trace.level = (TraceLevel)level;
+    ImGui::SameLine(); ImGui::SetNextItemWidth(90);
+    if (ImGui::InputInt("Keep 1 in N", &eng.trace.sampleEvery)) eng.trace.sampleEvery = max(1, eng.trace.sampleEvery);
+    Breakpoints& b = eng.breaks;
+    ImGui::Text("Break on:"); ImGui::SameLine();
+    ImGui::SetNextItemWidth(70); ImGui::InputInt("Token #", &b.tokenIndex, 0); ImGui::SameLine();
+    ImGui::SetNextItemWidth(70); ImGui::InputInt("Depth >", &b.stackDepth, 0); ImGui::SameLine();
+    ImGui::SetNextItemWidth(70); ImGui::InputInt("Row len >", &b.rowLength, 0); ImGui::SameLine();
+    ImGui::SetNextItemWidth(80); ImGui::InputText("On top", b.topSymbol, sizeof(b.topSymbol)); ImGui::SameLine();
+    ImGui::Checkbox("Error", &b.onError);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("-1 or an empty name turns a condition off; RUN stops where one fires");
+    ImGui::Checkbox("Record to", &recordTrace);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("Stream the selected engine's trace to this file from the next Reset / Load");
+    ImGui::SameLine(); ImGui::SetNextItemWidth(160); ImGui::InputText("##TracePath", tracePath, sizeof(tracePath)); ImGui::SameLine();
+    if (ImGui::Button("Open")) {
+        string error;
+        if (traceView.open(tracePath, error)) { showTraceFile = true; traceFileStatus = to_string(traceView.size()) + " steps mapped from " + tracePath; }
+        else traceFileStatus = error;
+    }
+    ImGui::SameLine(); if (!traceView.isOpen()) ImGui::BeginDisabled();
+    ImGui::Checkbox("Show file", &showTraceFile);
+    if (!traceView.isOpen()) ImGui::EndDisabled();
+    ImGui::SameLine(); ImGui::TextDisabled("%s", traceFileStatus.c_str());
+    bool fromFile = showTraceFile && traceView.isOpen();
     if (ImGui::BeginTable("TraceTable", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY)) {
         ImGui::TableSetupColumn("Input", ImGuiTableColumnFlags_WidthFixed, 50.0f); ImGui::TableSetupColumn("Action", ImGuiTableColumnFlags_WidthFixed, 150.0f); ImGui::TableSetupColumn("Stack State", ImGuiTableColumnFlags_WidthStretch); ImGui::TableHeadersRow();
-        for (const auto& log : engine.history) { ImGui::TableNextRow(); ImGui::TableSetColumnIndex(0); ImGui::Text("%s", log.input.c_str()); ImGui::TableSetColumnIndex(1); ImGui::Text("%s", log.action.c_str()); ImGui::TableSetColumnIndex(2); ImGui::Text("%s", log.stackState.c_str()); }
+        if (fromFile) {
+            // Only the visible rows are decoded, straight out of the mapping.
+            ImGuiListClipper clipper;
+            clipper.Begin((int)min<uint64_t>(traceView.size(), INT32_MAX));
+            while (clipper.Step())
+                for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                    TraceFile::Step st = traceView.at(i);
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0); ImGui::TextUnformatted(st.input.data(), st.input.data() + st.input.size());
+                    ImGui::TableSetColumnIndex(1); ImGui::TextUnformatted(st.action.data(), st.action.data() + st.action.size());
+                    ImGui::TableSetColumnIndex(2); ImGui::TextUnformatted(st.stackState.data(), st.stackState.data() + st.stackState.size());
+                }
+        }
+        else {
+            for (const auto& log : eng.history) { ImGui::TableNextRow(); ImGui::TableSetColumnIndex(0); ImGui::Text("%s", log.input.c_str()); ImGui::TableSetColumnIndex(1); ImGui::Text("%s", log.action.c_str()); ImGui::TableSetColumnIndex(2); ImGui::Text("%s", log.stackState.c_str()); }
+            // Evaluation plan of the loaded expression: the order each matrix chain is multiplied in.
+            for (const auto& log : evaluation.plan) { ImGui::TableNextRow(); ImGui::TableSetColumnIndex(0); ImGui::TextColored(ImVec4(0,0.4f,0.8f,1), "%s", log.input.c_str()); ImGui::TableSetColumnIndex(1); ImGui::Text("%s", log.action.c_str()); ImGui::TableSetColumnIndex(2); ImGui::TextWrapped("%s", log.stackState.c_str()); }
+        }
         if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY()) ImGui::SetScrollHereY(1.0f);
         ImGui::EndTable();
     }
     ImGui::End();
 }
 
-int main(int, char**) {
+// A recording ends with the run; only then is the file complete and the run cacheable.
+template<class E> void AfterStep(E& eng, RunCache<E>& runs) {
+    if (eng.sink && (eng.isFinished || eng.isLocked)) {
+        uint64_t steps = eng.sink->steps;
+        traceFileStatus = eng.sink->close() ? to_string(steps) + " steps written to " + tracePath : string("writing ") + tracePath + " failed";
+        eng.sink = NULL;
+    }
+    runs.store(eng);
+    if (evaluation.ready || !eng.isFinished || !eng.errors.empty() || eng.operands.size() != 2) return;
+    const Matrix &a = eng.operands[0], &b = eng.operands[1];
+    auto t0 = chrono::steady_clock::now();
+    evaluator.evaluate(eng.sem.op, a, b, evaluation.value);
+    evaluation.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    evaluation.flops = evaluator.flops; evaluation.sparseOperands = evaluator.sparseOperands;
+    evaluation.expression = string("A ") + eng.sem.op + " B"; evaluation.fused = eng.sem.op == '*' ? 0 : 2; evaluation.temporaries = 0; evaluation.plan.clear();
+    evaluation.strassenLevels = evaluator.strassenLevels;
+    evaluation.engine = is_same_v<E, LALREngine> ? "LALR" : "PDA"; evaluation.ready = true;
+}
+
+// Expressions the engines cannot take (parentheses, more than two operands) are evaluated from
+// the expression tree as soon as they are loaded.
+void EvaluateExpressionTree() {
+    if (exprParser.root < 0) return;
+    auto t0 = chrono::steady_clock::now();
+    evaluator.evaluate(exprParser.nodes, exprParser.root, evaluation.value);
+    evaluation.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    evaluation.flops = evaluator.flops; evaluation.plan = evaluator.plan;
+    evaluation.expression = exprParser.describe(exprParser.root);
+    evaluation.fused = evaluator.fusedOperands; evaluation.temporaries = evaluator.temporaries; evaluation.strassenLevels = evaluator.strassenLevels;
+    evaluation.sparseOperands = evaluator.sparseOperands;
+    evaluation.engine = "expression"; evaluation.ready = true;
+}
+
+template<class E> void RenderStepControls(E& eng, RunCache<E>& runs) {
+    bool disabled = eng.isLocked; if (disabled) ImGui::BeginDisabled();
+    if (ImGui::Button("STEP >>", ImVec2(150, 40))) { eng.step(); AfterStep(eng, runs); }
+    ImGui::SameLine();
+    if (ImGui::Button("RUN >|", ImVec2(80, 40))) { eng.run(); AfterStep(eng, runs); }
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("Run at full speed to the next breakpoint (Trace Log window) or to the end");
+    if (disabled) ImGui::EndDisabled();
+}
+
+template<class E> void RenderResult(const E& eng) {
+    if (!eng.breakReason.empty() && !eng.isLocked && !eng.isFinished) ImGui::TextColored(ImVec4(0.9f,0.5f,0,1), "BREAK: %s (token %d)", eng.breakReason.c_str(), eng.tokenCursor);
+    if (eng.isFinished && eng.errors.empty()) ImGui::TextColored(ImVec4(0,0.8f,0,1), "RESULT: %s", eng.statusMessage.c_str());
+    if ((eng.isLocked && !eng.isFinished) || (eng.isFinished && !eng.errors.empty())) {
+        ImGui::TextColored(ImVec4(1,0,0,1), "RESULT: %s", eng.statusMessage.c_str());
+        if (ImGui::IsItemHovered() && !eng.errors.empty()) {
+            ImGui::BeginTooltip();
+            for (const auto& e : eng.errors) ImGui::Text("@%d (token %d): %s", e.offset, e.tokenIndex, e.message.c_str());
+            ImGui::EndTooltip();
+        }
+    }
+}
+
+// The evaluated result of the accepted input, one table row per matrix row.
+void RenderEvaluation() {
+    ImGui::Begin("Result", NULL);
+    ImGui::SetNextItemWidth(120);
+    if (ImGui::SliderInt("Threads", &gemmThreads, 1, max(1, (int)thread::hardware_concurrency()))) gemmPool.resize(gemmThreads);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("Threads for the matrix multiply; applies from the next evaluation");
+    ImGui::SameLine(); ImGui::SetNextItemWidth(80);
+    int strassenMode = evaluator.strassen;
+    if (ImGui::Combo("Strassen", &strassenMode, StrassenModeNames, NUM_STRASSEN_MODES)) evaluator.strassen = static_cast<StrassenMode>(strassenMode);
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("Strassen-Winograd for multiplies with every side at least %d.\nexact: only when the result is bit-identical (integer operands)\nalways: floating point too, with slightly different rounding", 2 * evaluator.strassenCutover);
+    ImGui::SameLine(); ImGui::SetNextItemWidth(110);
+    float zeros = (float)evaluator.sparseZeroRatio * 100;
+    if (ImGui::SliderFloat("CSR", &zeros, 50, 101, zeros > 100 ? "off" : "%.0f%% zeros")) evaluator.sparseZeroRatio = zeros / 100;
+    if (ImGui::IsItemHovered()) ImGui::SetTooltip("Operands and results with at least this share of zeros are computed in compressed sparse rows");
+    if (!evaluation.ready) { ImGui::TextDisabled("Computed once the input is ACCEPTED"); ImGui::End(); return; }
+    const Matrix& r = evaluation.value;
+    ImGui::TextWrapped("%s = %dx%d", evaluation.expression.c_str(), r.rows, r.cols);
+    ImGui::Text("%s, %.3f ms, %.2f GFLOP/s", evaluation.engine, evaluation.seconds * 1e3, evaluation.seconds > 0 ? evaluation.flops / evaluation.seconds / 1e9 : 0.0);
+    if (evaluation.fused) {
+        ImGui::SameLine(); ImGui::TextDisabled("%s kernel", IsaNames[elementKernels.isa]);
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Largest fused +/- pass: %d operands in one loop. Temporaries: %d (only for * results).", evaluation.fused, evaluation.temporaries);
+    }
+    if (evaluation.strassenLevels) { ImGui::SameLine(); ImGui::TextDisabled("Strassen-Winograd, %d level%s", evaluation.strassenLevels, evaluation.strassenLevels > 1 ? "s" : ""); }
+    if (evaluation.sparseOperands) { ImGui::SameLine(); ImGui::TextDisabled("%d in CSR", evaluation.sparseOperands); }
+    int cols = min(r.cols, 64);
+    if (r.cols > cols) ImGui::TextDisabled("showing the first %d columns", cols);
+    if (ImGui::BeginTable("ResultTable", cols, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY)) {
+        ImGuiListClipper clipper; clipper.Begin(r.rows);
+        while (clipper.Step())
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+                ImGui::TableNextRow();
+                for (int j = 0; j < cols; j++) { ImGui::TableSetColumnIndex(j); ImGui::Text("%g", r.data[(size_t)i * r.cols + j]); }
+            }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+// Live verdict for the input box, with a red mark under the column the error points at.
+void RenderLiveStatus(ImVec2 inputMin, ImVec2 inputMax) {
+    LiveValidator::Verdict v = liveValidator.latest();
+    bool stale = liveValidator.stale();
+    if (!v.ready) { ImGui::TextDisabled("LIVE: checking..."); return; }
+    ImVec4 color = stale ? ImVec4(0.5f,0.5f,0.5f,1) : v.accepted ? ImVec4(0,0.6f,0,1) : ImVec4(0.9f,0,0,1);
+    if (v.accepted) ImGui::TextColored(color, "LIVE: ACCEPTED  %s", v.shapes.c_str());
+    else ImGui::TextColored(color, "LIVE: REJECTED @%d %s: %s", v.offset, ErrorKindName(v.kind), v.message.c_str());
+    int len = (int)strlen(inputBuffer);
+    if (stale || v.accepted || v.offset < 0 || v.offset > len) return;
+    float x = inputMin.x + ImGui::GetStyle().FramePadding.x + ImGui::CalcTextSize(inputBuffer, inputBuffer + v.offset).x;
+    float w = v.offset < len ? ImGui::CalcTextSize(inputBuffer + v.offset, inputBuffer + v.offset + 1).x : ImGui::CalcTextSize(" ").x;
+    if (x + w <= inputMax.x) ImGui::GetWindowDrawList()->AddLine(ImVec2(x, inputMax.y - 2), ImVec2(x + w, inputMax.y - 2), IM_COL32(230, 0, 0, 255), 2.0f);
+}
+
+template<class E> void RenderEngineWindows(E& eng) {
+    ImGui::SetNextWindowPos(ImVec2(0, 80)); ImGui::SetNextWindowSize(ImVec2(600, 400)); RenderNFA(eng);
+    ImGui::SetNextWindowPos(ImVec2(600, 80)); ImGui::SetNextWindowSize(ImVec2(600, 400)); RenderPDA(eng);
+    ImGui::SetNextWindowPos(ImVec2(0, 480)); ImGui::SetNextWindowSize(ImVec2(800, 420)); RenderTrace(eng);
+}
+
+void RenderExprNode(int n) {
+    const ExprNode& e = exprParser.nodes[n];
+    string label = e.op ? string(1, e.op) + "  -> " + to_string(e.rows) + "x" + to_string(e.cols)
+                        : "Matrix " + to_string(e.rows) + "x" + to_string(e.cols) + "  @" + to_string(e.offset);
+    ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_DefaultOpen | (e.op ? 0 : ImGuiTreeNodeFlags_Leaf);
+    if (ImGui::TreeNodeEx((void*)(intptr_t)n, flags, "%s", label.c_str())) {
+        if (e.op) { RenderExprNode(e.lhs); RenderExprNode(e.rhs); }
+        ImGui::TreePop();
+    }
+}
+
+void RenderExprTree() {
+    ImGui::Begin("Expression Tree", NULL);
+    if (exprParser.root >= 0) {
+        ImGui::TextColored(ImVec4(0,0.6f,0,1), "%s", exprParser.describe(exprParser.root).c_str());
+        ImGui::Separator();
+        RenderExprNode(exprParser.root);
+    } else if (exprParser.errorOffset < 0) {
+        ImGui::TextDisabled("%s", exprParser.message.c_str());
+    } else {
+        ImGui::TextColored(ImVec4(1,0,0,1), "@%d %s", exprParser.errorOffset, exprParser.message.c_str());
+    }
+    ImGui::End();
+}
+
+// ==========================================
+// COMMAND LINE (batch modes, no window)
+// ==========================================
+
+// Random near-valid expressions: mostly well formed and shape-compatible for the operator, with
+// shape slips and byte-level damage mixed in.
+string RandomExpression(mt19937& rng) {
+    auto pick = [&](int n) { return (int)(rng() % n); };
+    auto slip = [&](int n) { return pick(8) == 0 ? max(1, n + pick(3) - 1) : n; };
+    auto mat = [&](int rows, int cols) {
+        bool flat = (rows == 1 && pick(2) == 0);
+        string m = "[";
+        for (int r = 0; r < rows; r++) {
+            int c = slip(cols);
+            string row = flat ? "" : "[";
+            for (int i = 0; i < c; i++) row += (i ? "," : "") + to_string(pick(100));
+            m += (r ? "," : "") + row + (flat ? "" : "]");
+        }
+        m += "]";
+        return pick(10) == 0 ? to_string(pick(10)) + m : m;
+    };
+    char op = "+-*"[pick(3)];
+    int r1 = 1 + pick(3), c1 = 1 + pick(3);
+    int r2 = (op == '*') ? c1 : r1, c2 = (op == '*') ? 1 + pick(3) : c1;
+    string s = mat(r1, c1) + op + mat(slip(r2), c2);
+    int damage = pick(3) == 0 ? 1 + pick(3) : 0;
+    for (int i = 0; i < damage && !s.empty(); i++) {
+        int at = pick((int)s.size());
+        switch (pick(3)) {
+            case 0: s.erase(at, 1); break;
+            case 1: s.insert(s.begin() + at, "[],+-*5 x"[pick(9)]); break;
+            default: s[at] = "[],+-*7 "[pick(8)]; break;
+        }
+    }
+    return s;
+}
+
+// Square rows x cols literal on both sides of `op`; the workload for throughput numbers.
+string LargeExpression(int rows, int cols, char op) {
+    string m = "[";
+    for (int r = 0; r < rows; r++) {
+        m += r ? ",[" : "[";
+        for (int c = 0; c < cols; c++) { if (c) m += ','; m += to_string((r * 7 + c * 13) % 100); }
+        m += "]";
+    }
+    m += "]";
+    return m + op + m;
+}
+
+// Trace settings for engines in batch modes, from --trace <level>[:N]. Full by default.
+TraceFilter batchTrace;
+
+double SecondsSince(chrono::steady_clock::time_point t0) { return chrono::duration<double>(chrono::steady_clock::now() - t0).count(); }
+
+// Error recovery (--validate): known inputs must report exactly these errors, with no follow-on
+// shape errors from rows recovery dropped. On random inputs every operand must keep rows x cols values.
+int CheckRecovery(mt19937& rng, int rounds) {
+    struct Case { const char* input; vector<ErrorKind> kinds; };
+    const Case cases[] = {
+        {"[[1,x],[3,4]]+[[1,2],[3,4]] 5", {ERR_SYNTAX, ERR_TRAILING}},
+        {"[[1,2],[3]]+[[1,2],[3,4]]", {ERR_1X1}},
+        {"[[1,2],[3,4,5],[6,7]]*[[1,2],[3,4]]", {ERR_ROW_MISMATCH}},
+        {"[[1,2],[3,4]]*[[1,2,3],[4]]", {ERR_1X1}},
+        {"2[[1,2],[3,4]]+[[1,2],[3,4]]", {}},
+    };
+    int mismatches = 0;
+    ParseOnlyEngine pda; pda.recoverErrors = true;
+    for (const Case& c : cases) {
+        pda.reset(c.input); pda.run();
+        vector<ErrorKind> got;
+        for (const ParseError& e : pda.errors) got.push_back(e.kind);
+        if (got == c.kinds) continue;
+        mismatches++;
+        cout << "RECOVERY MISMATCH \"" << c.input << "\": got";
+        for (ErrorKind k : got) cout << " " << ErrorKindName(k);
+        cout << "\n";
+    }
+    for (int r = 0; r < rounds; r++) {
+        string s = RandomExpression(rng);
+        pda.reset(s); pda.run();
+        for (const Matrix& m : pda.operands)
+            if (m.data.size() != (size_t)m.rows * m.cols && mismatches++ < 5) cout << "RECOVERY LEFT " << m.data.size() << " VALUES IN A " << m.rows << "x" << m.cols << " OPERAND: " << s << "\n";
+    }
+    cout << rounds << " recovered parses and " << size(cases) << " known cases, " << mismatches << " mismatches\n";
+    return mismatches;
+}
+
+// Breakpoints on a traced PDA: each token index, 0 included, must stop the run once, right after
+// that token is consumed.
+int CheckBreakpoints() {
+    const char* input = "[[1,2],[3,4]]*[[5,6],[7,8]]";
+    int mismatches = 0, tokens = 0;
+    ParserEngine pda;
+    pda.trace.level = TRACE_ERRORS;
+    for (int i = 0;; i++) {
+        pda.breaks.tokenIndex = i;
+        pda.reset(input); pda.run();
+        tokens = (int)pda.tokenStream.size() - 1;   // the end marker is never consumed
+        if (i >= tokens) break;
+        bool ok = pda.breakReason == "token " + to_string(i) + " consumed" && (int)pda.tokenCursor == i + 1;
+        pda.run();
+        ok = ok && pda.isFinished && pda.breakReason.empty();
+        if (!ok && mismatches++ < 5) cout << "BREAKPOINT ON TOKEN " << i << " STOPPED AT " << pda.tokenCursor << ": " << pda.breakReason << "\n";
+    }
+    cout << tokens << " token breakpoints, " << mismatches << " mismatches\n";
+    return mismatches;
+}
+
+// Random edits fed through IncrementalParser, each checked against a full parse of the result.
+int CheckIncremental(mt19937& rng, int rounds) {
+    int mismatches = 0, edits = 0, resynced = 0;
+    for (int r = 0; r < rounds; r++) {
+        int n = 2 + rng() % 14;
+        string s = LargeExpression(n, n, "+-*"[rng() % 3]);
+        if (rng() % 2) s.insert(s.size() / 2 + 1, to_string(2 + rng() % 8));   // scalar prefixes, which edits may also hit
+        if (rng() % 2) s.insert(0, to_string(2 + rng() % 8));
+        IncrementalParser inc; inc.checkpointEvery = 1 + rng() % 16; inc.parse(s);
+        for (int e = 0; e < 20; e++, edits++) {
+            size_t at = rng() % (s.size() + 1);
+            switch (rng() % 4) {
+                case 0: if (at < s.size()) s.erase(at, 1); break;
+                case 1: s.insert(s.begin() + at, "[],+-*0123456789 "[rng() % 17]); break;
+                default: if (at < s.size() && isdigit((unsigned char)s[at])) s[at] = '0' + rng() % 10; break;
+            }
+            inc.update(s);
+            resynced += inc.resynced;
+            ParseOnlyEngine full; full.earlyShapeCheck = false; full.reset(s); full.run();
+            const ParseOnlyEngine& got = inc.eng;
+            bool same = full.errorKind == got.errorKind && full.errorOffset == got.errorOffset && full.operands.size() == got.operands.size();
+            for (size_t k = 0; same && k < full.operands.size(); k++)
+                same = full.operands[k].rows == got.operands[k].rows && full.operands[k].cols == got.operands[k].cols &&
+                       full.operands[k].scale == got.operands[k].scale && full.operands[k].data == got.operands[k].data;
+            if (!same && mismatches++ < 5)
+                cout << "INCREMENTAL MISMATCH \"" << s << "\": full=" << ErrorKindName(full.errorKind) << "@" << full.errorOffset
+                     << " incremental=" << ErrorKindName(got.errorKind) << "@" << got.errorOffset << "\n";
+        }
+    }
+    cout << edits << " incremental edits, " << resynced << " resynced early, " << mismatches << " mismatches\n";
+    return mismatches;
+}
+
+// StructuralIndexer against FastValidator: random expressions shifted across 64-byte block
+// boundaries, and mutated large inputs. Results must be identical, message included.
+int CheckStructural(mt19937& rng, int rounds) {
+    int mismatches = 0;
+    for (int r = 0; r < rounds; r++) {
+        string s = r % 8 ? RandomExpression(rng) : LargeExpression(2 + rng() % 30, 2 + rng() % 30, "+-*"[rng() % 3]);
+        s.insert(0, string(rng() % 70, ' '));
+        for (int e = rng() % 3; e > 0; e--) s.insert(s.begin() + rng() % (s.size() + 1), "[],+-*5 \t"[rng() % 9]);
+        ValidationResult a = FastValidator().validate(s), b = StructuralIndexer().validate(s);
+        bool same = a.kind == b.kind && a.offset == b.offset && a.message == b.message &&
+                    a.rows1 == b.rows1 && a.cols1 == b.cols1 && a.rows2 == b.rows2 && a.cols2 == b.cols2;
+        if (!same && mismatches++ < 5)
+            cout << "STRUCTURAL MISMATCH \"" << s << "\": fast=" << ErrorKindName(a.kind) << "@" << a.offset
+                 << " structural=" << ErrorKindName(b.kind) << "@" << b.offset << "\n";
+    }
+    cout << rounds << " structural index checks, " << mismatches << " mismatches\n";
+    return mismatches;
+}
+
+// Random operand pairs, with and without scalar prefixes, parsed by the PDA and evaluated by the
+// blocked kernels and by NaiveEvaluate. Small integers keep every sum exact, so results must match bit for bit.
+int CheckEvaluation(mt19937& rng, int rounds) {
+    auto literal = [&](int rows, int cols) {
+        string m = rng() % 4 ? "" : to_string(rng() % 5);
+        bool sparse = rng() % 3 == 0;   // about 97% zeros, so the evaluator switches it to CSR
+        m += "[";
+        for (int r = 0; r < rows; r++) {
+            m += r ? ",[" : "[";
+            for (int c = 0; c < cols; c++) { if (c) m += ','; m += sparse && rng() % 32 ? "0" : to_string(rng() % 20); }
+            m += "]";
+        }
+        return m + "]";
+    };
+    int mismatches = 0;
+    MatrixEvaluator ev, sw; ParseOnlyEngine pda;
+    ev.pool = sw.pool = &gemmPool;
+    sw.strassenCutover = 4;   // Strassen-Winograd on nearly every product, odd sides included
+    int strassenRuns = 0, sparseRuns = 0;
+    for (int r = 0; r < rounds; r++) {
+        char op = "+-*"[rng() % 3];
+        int big = r % 10 == 0 ? 300 : 40, m = 1 + rng() % big, k = 2 + rng() % big, n = 2 + rng() % big;
+        string s = op == '*' ? literal(m, k) + op + literal(k, n) : literal(m, n) + op + literal(m, n);
+        pda.reset(s); pda.run();
+        if (!pda.isFinished || !pda.errors.empty()) { if (mismatches++ < 5) cout << "EVALUATION INPUT REJECTED " << s.substr(0, 60) << "...\n"; continue; }
+        Matrix fast, ref;
+        ev.evaluate(op, pda.operands[0], pda.operands[1], fast); NaiveEvaluate(op, pda.operands[0], pda.operands[1], ref);
+        sparseRuns += ev.sparseOperands > 0;
+        if ((fast.rows != ref.rows || fast.cols != ref.cols || fast.data != ref.data) && mismatches++ < 5)
+            cout << "EVALUATION MISMATCH " << op << " on " << pda.operands[0].rows << "x" << pda.operands[0].cols << " and "
+                 << pda.operands[1].rows << "x" << pda.operands[1].cols << "\n";
+        if (op != '*') continue;
+        sw.evaluate(op, pda.operands[0], pda.operands[1], fast);
+        strassenRuns += sw.strassenLevels > 0;
+        if (fast.data != ref.data && mismatches++ < 5)
+            cout << "STRASSEN MISMATCH on " << pda.operands[0].rows << "x" << pda.operands[0].cols << " and " << pda.operands[1].rows << "x" << pda.operands[1].cols << "\n";
+    }
+    // Expression trees: random shape-compatible expressions, fused against pairwise evaluation.
+    function<string(int, int, int)> expr = [&](int rows, int cols, int depth) -> string {
+        if (depth == 0 || rng() % 4 == 0) return literal(rows, cols);
+        int op = rng() % 4;
+        if (op == 3) {   // flat chain A*B*C..., left for the evaluator to reorder
+            string s = "(";
+            for (int f = 0, k = 2 + rng() % 4, r = rows; f < k; f++) {
+                int c = f == k - 1 ? cols : 2 + rng() % 12;
+                s += (f ? "*" : "") + literal(r, c); r = c;
+            }
+            return s + ")";
+        }
+        if (op == 2) { int k = 2 + rng() % 12; return "(" + expr(rows, k, depth - 1) + ")*(" + expr(k, cols, depth - 1) + ")"; }
+        string lhs = expr(rows, cols, depth - 1), rhs = expr(rows, cols, depth - 1);
+        return rng() % 2 ? lhs + "+-"[op] + rhs : "(" + lhs + "+-"[op] + rhs + ")";
+    };
+    // Every product is exact below 2^53. Past that, a reordered chain rounds differently, so allow a relative error.
+    auto same = [](const Matrix& a, const Matrix& b) {
+        if (a.rows != b.rows || a.cols != b.cols) return false;
+        for (size_t i = 0; i < a.data.size(); i++)
+            if (a.data[i] != b.data[i] && (fabs(b.data[i]) < 0x1p53 || fabs(a.data[i] - b.data[i]) > 1e-12 * fabs(b.data[i]))) return false;
+        return true;
+    };
+    ExprParser ep;
+    for (int r = 0; r < rounds; r++) {
+        string s = expr(1 + rng() % 12, 2 + rng() % 12, 1 + rng() % 4);
+        if (!ep.parse(s)) { if (mismatches++ < 5) cout << "EXPRESSION REJECTED " << s << ": " << ep.message << "\n"; continue; }
+        Matrix fast, ref;
+        ev.evaluate(ep.nodes, ep.root, fast); NaiveEvaluate(ep.nodes, ep.root, ref);
+        sparseRuns += ev.sparseOperands > 0;
+        if (!same(fast, ref) && mismatches++ < 5) cout << "EXPRESSION MISMATCH " << s << "\n";
+    }
+    cout << rounds << " evaluations (" << strassenRuns << " also by Strassen-Winograd) and " << rounds << " expression trees against the reference, "
+         << sparseRuns << " of them with CSR operands, " << mismatches << " mismatches\n";
+    return mismatches;
+}
+
+// The validators and known cases it checks are the built-in language's, so a loaded grammar with
+// other rules is set aside for the run.
+int RunDifferential(int count) {
+    if (!BuiltinRules(activeGrammar)) { cerr << "diff: the loaded grammar is not the built-in one; checking the built-in grammar\n"; activeGrammar = &LL1; }
+    mt19937 rng(12345);
+    int mismatches = 0, accepted = 0;
+    for (int i = 0; i < count; i++) {
+        string s = RandomExpression(rng), report;
+        if (!DifferentialCheck(s, &report)) { if (mismatches++ < 20) cout << "MISMATCH " << report << "\n"; }
+        else if (FastValidator().validate(s).ok()) accepted++;
+    }
+    cout << count << " inputs, " << accepted << " accepted, " << mismatches << " mismatches\n";
+
+    string big = LargeExpression(300, 300, '+'), report;
+    if (!DifferentialCheck(big, &report)) { cout << "MISMATCH on large input\n"; mismatches++; }
+    auto t0 = chrono::steady_clock::now();
+    ParserEngine pda; pda.trace = batchTrace; pda.reset(big); pda.run();
+    double pdaSec = SecondsSince(t0);
+    t0 = chrono::steady_clock::now();
+    int reps = 50; for (int i = 0; i < reps; i++) FastValidator().validate(big);
+    double fastSec = SecondsSince(t0) / reps;
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < reps; i++) StructuralIndexer().validate(big);
+    double simdSec = SecondsSince(t0) / reps;
+    cout << "Throughput on " << big.size() / 1024 << " KB: PDA " << big.size() / pdaSec / 1e6 << " MB/s, fast " << big.size() / fastSec / 1e6
+         << " MB/s, structural " << big.size() / simdSec / 1e6 << " MB/s\n";
+    mismatches += CheckStructural(rng, max(1, count / 10));
+    mismatches += CheckRecovery(rng, max(1, count / 10));
+    mismatches += CheckBreakpoints();
+    mismatches += CheckIncremental(rng, max(1, count / 500));
+    mismatches += CheckEvaluation(rng, max(1, count / 1000));
+    return mismatches ? 1 : 0;
+}
+
+// Top-down PDA vs bottom-up LALR on the same pre-lexed token stream, growing operand sizes.
+int RunParserBenchmark() {
+    const LALRTables& T = LALRTables::get(activeGrammar);
+    int dense = T.numStates * T.numTerminals, sparse = (int)T.actionSym.size() + T.numStates;
+    cout << "LALR(1): " << T.numStates << " states, " << T.conflicts << " conflicts, action table " << sparse << " of " << dense << " dense cells\n";
+    cout << "size      tokens   PDA tok/s  untraced tok/s   LALR tok/s    faster\n";
+    for (int n : {4, 16, 64, 160}) {
+        Lexer lx; lx.init(LargeExpression(n, n, '+'));
+        vector<Token> toks = lx.tokenizeAll();
+        ParserEngine pda; ParseOnlyEngine bare; LALREngine lalr;
+        pda.trace = lalr.trace = batchTrace;
+        auto t0 = chrono::steady_clock::now();
+        int reps = max(1, 20000 / (n * n));
+        for (int r = 0; r < reps; r++) { pda.resetTokens(toks); pda.run(); }
+        double pdaSec = SecondsSince(t0) / reps;
+        t0 = chrono::steady_clock::now();
+        for (int r = 0; r < reps * 4; r++) { bare.resetTokens(toks); bare.run(); }
+        double bareSec = SecondsSince(t0) / (reps * 4);
+        t0 = chrono::steady_clock::now();
+        for (int r = 0; r < reps; r++) { lalr.resetTokens(toks); lalr.run(); }
+        double lalrSec = SecondsSince(t0) / reps;
+        if (!pda.isFinished || !bare.isFinished || !lalr.isFinished) { cout << "benchmark input rejected\n"; return 1; }
+        printf("%4dx%-4d %8zu %12.0f %15.0f %12.0f    %s\n", n, n, toks.size(), toks.size() / pdaSec, toks.size() / bareSec, toks.size() / lalrSec, pdaSec <= lalrSec ? "PDA" : "LALR");
+    }
+
+    // Incremental: a one-digit edit in the middle of a large input, against parsing it from scratch.
+    string big = LargeExpression(300, 300, '+');
+    IncrementalParser inc;
+    auto t0 = chrono::steady_clock::now();
+    inc.parse(big);
+    double fullSec = SecondsSince(t0);
+    size_t mid = big.size() / 2;
+    while (!isdigit((unsigned char)big[mid])) mid++;
+    big.insert(mid, "7");
+    t0 = chrono::steady_clock::now();
+    inc.update(big);
+    double editSec = SecondsSince(t0);
+    printf("incremental, %zu KB: full parse %.1f ms, one-digit edit %.3f ms (%d tokens re-parsed, %s)\n", big.size() / 1024,
+           fullSec * 1e3, editSec * 1e3, inc.reparsedTokens, inc.resynced ? "resynced" : "ran to the end");
+
+    // Run cache: reloading a finished traced run, against running it again.
+    string seen = LargeExpression(64, 64, '*');
+    RunCache<ParserEngine> runs; ParserEngine traced; traced.trace = batchTrace;
+    t0 = chrono::steady_clock::now();
+    runs.load(traced, seen); traced.run(); runs.store(traced);
+    double runSec = SecondsSince(t0);
+    traced.reset("");
+    t0 = chrono::steady_clock::now();
+    runs.load(traced, seen);
+    double reloadSec = SecondsSince(t0);
+    printf("run cache, %zu KB: traced run %.2f ms, reload %.2f ms (%zu trace entries, %s)\n", seen.size() / 1024,
+           runSec * 1e3, reloadSec * 1e3, traced.history.size(), runs.hits ? "hit" : "miss");
+    return 0;
+}
+
+// Blocked kernels against the naive loops on square operands of growing size.
+int RunEvalBenchmark() {
+    mt19937 rng(7);
+    MatrixEvaluator ev;
+    cout << "size        op   blocked GFLOP/s   naive GFLOP/s   speedup   max |diff|\n";
+    for (int n : {64, 128, 256, 512, 1024}) {
+        Matrix a, b, fast, ref;
+        a.rows = a.cols = b.rows = b.cols = n;
+        uniform_real_distribution<double> u(-1, 1);
+        for (int i = 0; i < n * n; i++) { a.data.push_back(u(rng)); b.data.push_back(u(rng)); }
+        for (char op : {'*', '+'}) {
+            double flops = EvaluationFlops(op, n, n, n);
+            int reps = max(1, (int)(2e8 / flops));
+            auto t0 = chrono::steady_clock::now();
+            for (int r = 0; r < reps; r++) ev.evaluate(op, a, b, fast);
+            double fastSec = SecondsSince(t0) / reps;
+            int naiveReps = max(1, reps / 4);
+            t0 = chrono::steady_clock::now();
+            for (int r = 0; r < naiveReps; r++) NaiveEvaluate(op, a, b, ref);
+            double naiveSec = SecondsSince(t0) / naiveReps;
+            double diff = 0;
+            for (size_t i = 0; i < ref.data.size(); i++) diff = max(diff, fabs(fast.data[i] - ref.data[i]));
+            printf("%4dx%-4d    %c   %15.2f %15.2f %8.1fx   %.1e\n", n, n, op, flops / fastSec / 1e9, flops / naiveSec / 1e9, naiveSec / fastSec, diff);
+            if (diff > 1e-9 * n) { cout << "result differs from the reference\n"; return 1; }
+        }
+    }
+
+    // Fused +/- chains against pairwise evaluation, which writes a temporary for every operator.
+    {
+        int n = 2048;
+        vector<ExprNode> nodes;
+        for (int i = 0; i < 8; i++) { ExprNode leaf; leaf.rows = leaf.cols = leaf.value.rows = leaf.value.cols = n; leaf.value.data.assign((size_t)n * n, i + 1); nodes.push_back(leaf); }
+        printf("\nfused chains, %dx%d operands   fused ms   pairwise ms   speedup   temporaries (fused / pairwise)\n", n, n);
+        for (int count : {2, 4, 8}) {
+            vector<ExprNode> tree(nodes.begin(), nodes.begin() + count);
+            int root = 0;
+            for (int i = 1; i < count; i++) {
+                ExprNode e; e.op = i % 2 ? '+' : '-'; e.lhs = root; e.rhs = i; e.rows = e.cols = n;
+                tree.push_back(e); root = (int)tree.size() - 1;
+            }
+            // Every operator writes a fresh matrix, as a naive evaluator would; leaves are used in place.
+            function<const Matrix&(int, deque<Matrix>&)> byPairs = [&](int k, deque<Matrix>& made) -> const Matrix& {
+                if (!tree[k].op) return tree[k].value;
+                const Matrix &a = byPairs(tree[k].lhs, made), &b = byPairs(tree[k].rhs, made);
+                Matrix& out = made.emplace_back();
+                ev.evaluate(tree[k].op, a, b, out);
+                return out;
+            };
+            Matrix fused, pairwise;
+            auto t0 = chrono::steady_clock::now();
+            for (int r = 0; r < 3; r++) { Matrix out; ev.evaluate(tree, root, out); fused = move(out); }
+            double fusedSec = SecondsSince(t0) / 3;
+            t0 = chrono::steady_clock::now();
+            for (int r = 0; r < 3; r++) { deque<Matrix> made; byPairs(root, made); pairwise = move(made.back()); }
+            double pairSec = SecondsSince(t0) / 3;
+            printf("%10d operands %21.1f %13.1f %8.2fx %11d / %d\n", count, fusedSec * 1e3, pairSec * 1e3, pairSec / fusedSec, ev.temporaries, count - 2);
+            if (fused.data != pairwise.data) { cout << "fused result differs\n"; return 1; }
+        }
+    }
+
+    // Matrix chains: the dynamic program's order against multiplying left to right.
+    {
+        vector<vector<int>> chains = {{1500, 20, 1500, 20, 1500, 5}, {10, 1000, 10, 1000, 10}, {800, 800, 800, 800, 800}};
+        printf("\nmatrix chain                        DP order ms   left-to-right ms   est. FLOP ratio\n");
+        for (const vector<int>& dims : chains) {
+            vector<ExprNode> tree;
+            string shape;
+            for (size_t i = 0; i + 1 < dims.size(); i++) {
+                ExprNode leaf; leaf.rows = leaf.value.rows = dims[i]; leaf.cols = leaf.value.cols = dims[i + 1];
+                leaf.value.data.assign((size_t)dims[i] * dims[i + 1], 1.0 / (i + 1));
+                tree.push_back(leaf);
+                shape += (i ? "x" : "") + to_string(dims[i]);
+            }
+            shape += "x" + to_string(dims.back());
+            int root = 0, leaves = (int)tree.size();
+            for (int i = 1; i < leaves; i++) {
+                ExprNode e; e.op = '*'; e.lhs = root; e.rhs = i; e.rows = dims[0]; e.cols = dims[i + 1];
+                tree.push_back(e); root = (int)tree.size() - 1;
+            }
+            Matrix best, naive;
+            double sec[2], cost[2];
+            for (int reorder = 1; reorder >= 0; reorder--) {
+                ev.reorderChains = reorder; sec[reorder] = 1e30;
+                for (int rep = 0; rep < 3; rep++) {
+                    auto t0 = chrono::steady_clock::now();
+                    ev.evaluate(tree, root, reorder ? best : naive);
+                    sec[reorder] = min(sec[reorder], SecondsSince(t0)); cost[reorder] = ev.flops;
+                }
+            }
+            ev.reorderChains = true;
+            double diff = 0;
+            for (size_t i = 0; i < best.data.size(); i++) diff = max(diff, fabs(best.data[i] - naive.data[i]) / max(1.0, fabs(naive.data[i])));
+            printf("%-35s %11.1f %18.1f %17.1fx\n", shape.c_str(), sec[1] * 1e3, sec[0] * 1e3, cost[0] / cost[1]);
+            if (diff > 1e-9) { cout << "reordered result differs\n"; return 1; }
+        }
+    }
+
+    // Strassen-Winograd against the classic kernel, per cutover. Integer operands, so the results
+    // must be identical; the last column is the error on random floats, which needs "always".
+    {
+        vector<int> cutovers = {64, 128, 256, 512};
+        printf("\nStrassen-Winograd    classic ms");
+        for (int c : cutovers) printf("   cutover %3d ms", c);
+        printf("   float rel. error\n");
+        for (int n : {512, 1024, 1536, 2048}) {
+            Matrix a, b, classic, fast;
+            a.rows = a.cols = b.rows = b.cols = n;
+            uniform_int_distribution<int> u(-8, 8);
+            for (int i = 0; i < n * n; i++) { a.data.push_back(u(rng)); b.data.push_back(u(rng)); }
+            ev.strassen = STRASSEN_OFF;
+            auto t0 = chrono::steady_clock::now();
+            ev.evaluate('*', a, b, classic);
+            printf("%4dx%-4d %17.1f", n, n, SecondsSince(t0) * 1e3);
+            ev.strassen = STRASSEN_EXACT;
+            for (int c : cutovers) {
+                ev.strassenCutover = c;
+                t0 = chrono::steady_clock::now();
+                ev.evaluate('*', a, b, fast);
+                double sec = SecondsSince(t0);
+                if (ev.strassenLevels) printf("   %6.1f (%d lvl)", sec * 1e3, ev.strassenLevels);
+                else printf("   %15s", "-");
+                if (fast.data != classic.data) { cout << "\nStrassen-Winograd result differs on integers\n"; return 1; }
+            }
+            // Same operands scaled to non-integers: now only "always" takes the Strassen path.
+            for (double& v : a.data) v /= 3;
+            ev.strassen = STRASSEN_OFF; ev.evaluate('*', a, b, classic);
+            ev.strassen = STRASSEN_ALWAYS; ev.strassenCutover = cutovers[0]; ev.evaluate('*', a, b, fast);
+            double err = 0, norm = 0;
+            for (size_t i = 0; i < fast.data.size(); i++) { err = max(err, fabs(fast.data[i] - classic.data[i])); norm = max(norm, fabs(classic.data[i])); }
+            printf("   %16.1e\n", norm > 0 ? err / norm : 0.0);
+        }
+        ev.strassen = STRASSEN_EXACT; ev.strassenCutover = STRASSEN_CUTOVER;
+    }
+
+    // CSR against dense kernels as the share of non-zeros falls: sparse * dense, sparse * sparse and a
+    // sum of two sparse products, with the memory each representation takes for one operand.
+    {
+        int n = 1024;
+        printf("\nsparse %dx%d   S*D dense ms   CSR ms   S*S dense ms   CSR ms   S*S+S*S dense ms   CSR ms   operand KB dense / CSR\n", n, n);
+        for (double density : {0.3, 0.1, 0.03, 0.01, 0.001}) {
+            Matrix a, b, full, x, y;
+            uniform_real_distribution<double> u(-1, 1);
+            auto make = [&](Matrix& m, double d) {
+                m.rows = m.cols = n; m.data.resize((size_t)n * n); m.nonzeros = 0;
+                for (double& v : m.data) { v = u(rng) + 1 < 2 * d ? u(rng) : 0.0; m.nonzeros += v != 0; }
+            };
+            make(a, density); make(b, density); make(full, 1);
+            full.nonzeros = -1;   // not counted, so it stays dense even with every operand forced to CSR
+            vector<ExprNode> tree(5);   // A*B + B*A
+            tree[0].value = a; tree[1].value = b;
+            for (int i = 0; i < 5; i++) tree[i].rows = tree[i].cols = n;
+            tree[2].op = tree[3].op = '*'; tree[2].lhs = tree[3].rhs = 0; tree[2].rhs = tree[3].lhs = 1;
+            tree[4].op = '+'; tree[4].lhs = 2; tree[4].rhs = 3;
+            double ms[6];
+            for (int sparse = 0; sparse < 2; sparse++) {
+                ev.sparseZeroRatio = sparse ? 0 : 2;   // 0: every operand goes to CSR; 2: none does
+                auto time = [&](char op, const Matrix& l, const Matrix& r, Matrix& out) {
+                    auto t0 = chrono::steady_clock::now();
+                    ev.evaluate(op, l, r, out);
+                    return SecondsSince(t0) * 1e3;
+                };
+                ms[sparse] = time('*', a, full, sparse ? y : x);
+                ms[2 + sparse] = time('*', a, b, sparse ? y : x);
+                auto t0 = chrono::steady_clock::now();
+                ev.evaluate(tree, 4, sparse ? y : x);
+                ms[4 + sparse] = SecondsSince(t0) * 1e3;
+            }
+            ev.sparseZeroRatio = SPARSE_ZERO_RATIO;
+            Matrix csr; CompressRows(a, csr);
+            double diff = 0;
+            for (size_t i = 0; i < x.data.size(); i++) diff = max(diff, fabs(x.data[i] - y.data[i]));
+            printf("%5.1f%% non-zero %11.1f %8.1f %14.1f %8.1f %18.1f %8.1f %12zu / %zu\n", density * 100, ms[0], ms[1], ms[2], ms[3], ms[4], ms[5],
+                   a.data.size() * sizeof(double) / 1024, (csr.values.size() * (sizeof(double) + sizeof(int)) + csr.rowStart.size() * sizeof(int)) / 1024);
+            if (diff > 1e-9) { cout << "CSR result differs\n"; return 1; }
+        }
+    }
+
+    // Strong scaling: one fixed multiply on 1, 2, 4, ... threads up to the pool's size.
+    {
+        int n = 2048, most = gemmPool.size();
+        Matrix a, b, c;
+        a.rows = a.cols = b.rows = b.cols = n;
+        a.data.assign((size_t)n * n, 0.5); b.data.assign((size_t)n * n, 0.25);
+        ev.pool = &gemmPool;
+        printf("\nstrong scaling, %dx%d *\nthreads   GFLOP/s   speedup   efficiency   steals\n", n, n);
+        double base = 0;
+        for (int t = 1; t <= most; t = t < most && t * 2 > most ? most : t * 2) {
+            gemmPool.resize(t); gemmPool.steals = 0;
+            auto t0 = chrono::steady_clock::now();
+            ev.evaluate('*', a, b, c);
+            double sec = SecondsSince(t0);
+            if (t == 1) base = sec;
+            printf("%7d %9.2f %8.2fx %11.0f%% %8lld\n", t, EvaluationFlops('*', n, n, n) / sec / 1e9, base / sec, base / sec / t * 100, gemmPool.steals.load());
+            if (c.data[(size_t)n * n - 1] != 0.125 * n) { cout << "result is wrong\n"; return 1; }
+            if (t == most) break;
+        }
+        gemmPool.resize(most);
+    }
+
+    // Element-wise kernels per ISA: an operand that fits in cache, and one whose result is past the
+    // last-level cache, written with ordinary and with non-temporal stores. Traffic is 24 bytes per element.
+    size_t cached = 512 * 512, large = max((size_t)4096 * 4096, elementKernels.streamBytes / sizeof(double) * 5 / 4);
+    vector<double> x(large, 1.5), y(large, 2.5), z(large, 0.0);
+    printf("\nelement-wise z = a*x + b*y, GB/s (last-level cache %zu MB, selected %s)\n", elementKernels.streamBytes >> 20, IsaNames[elementKernels.isa]);
+    printf("isa      in cache %4zu KB   %zu MB stores   %zu MB streamed\n", cached * 8 >> 10, large * 8 >> 20, large * 8 >> 20);
+    for (int i = 0; i < NUM_ISAS; i++) {
+        if (!IsaSupported((SimdIsa)i)) { printf("%-8s not supported by this CPU or build\n", IsaNames[i]); continue; }
+        CombineKernel k = CombineFor((SimdIsa)i);
+        auto rate = [&](size_t n, bool stream, int reps) {
+            double c[2] = {1, -1}; const double* src[2] = {x.data(), y.data()};
+            k(n, 2, c, src, z.data(), stream);
+            auto t0 = chrono::steady_clock::now();
+            for (int r = 0; r < reps; r++) k(n, 2, c, src, z.data(), stream);
+            return 24.0 * n * reps / SecondsSince(t0) / 1e9;
+        };
+        printf("%-8s %17.1f %15.1f %17.1f\n", IsaNames[i], rate(cached, false, 2000), rate(large, false, 5), rate(large, true, 5));
+        for (size_t j = 0; j < large; j += large / 7) if (z[j] != -1.0) { cout << "kernel result is wrong\n"; return 1; }
+    }
+    return 0;
+}
+
+// One expression per line; every error of every line is reported in a single pass.
+int RunValidateFile(const char* path) {
+    ifstream in(path);
+    if (!in) { cerr << "cannot open " << path << "\n"; return 2; }
+    ParserEngine pda; pda.recoverErrors = true; pda.trace = batchTrace;
+    string line; int lineNo = 0, rejected = 0;
+    while (getline(in, line)) {
+        lineNo++;
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        pda.reset(line); pda.run();
+        if (pda.errors.empty()) continue;
+        rejected++;
+        for (const auto& e : pda.errors)
+            cout << path << ":" << lineNo << ":" << e.offset + 1 << ": " << ErrorKindName(e.kind) << ": " << e.message << "\n";
+    }
+    cout << lineNo << " lines, " << rejected << " rejected\n";
+    return rejected ? 1 : 0;
+}
+
+// --record: one traced PDA run streamed to a trace file without keeping it in memory.
+// The expression is given inline or, as @path, read from a file.
+int RunRecordTrace(const char* path, string input) {
+    if (!input.empty() && input[0] == '@') {
+        ifstream in(input.substr(1), ios::binary);
+        if (!in) { cerr << "cannot open " << input.substr(1) << "\n"; return 2; }
+        input.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        while (!input.empty() && isspace((unsigned char)input.back())) input.pop_back();
+    }
+    TraceWriter out;
+    if (!out.open(path)) { cerr << "cannot write " << path << "\n"; return 2; }
+    ParserEngine pda; pda.trace = batchTrace; pda.keepHistory = false; pda.sink = &out;
+    auto t0 = chrono::steady_clock::now();
+    pda.reset(input); pda.run();
+    uint64_t steps = out.steps;
+    if (!out.close()) { cerr << "writing " << path << " failed\n"; return 2; }
+    printf("%s: %llu steps in %.2f s, verdict %s\n", path, (unsigned long long)steps, SecondsSince(t0), pda.statusMessage.c_str());
+    return 0;
+}
+
+// --replay: print steps [first, first + count) of a trace file, read through the mapping.
+int RunReplayTrace(const char* path, long long first, long long count) {
+    TraceFile f; string error;
+    if (!f.open(path, error)) { cerr << path << ": " << error << "\n"; return 2; }
+    cout << path << ": " << f.size() << " steps\n";
+    for (long long i = max(0LL, first); i < first + count && (uint64_t)i < f.size(); i++) {
+        TraceFile::Step st = f.at(i);
+        cout << i << "\t" << st.input << "\t" << st.action << "\t" << st.stackState << "\n";
+    }
+    return 0;
+}
+
+// --grammar <file>, else ./matrix.grammar when present; anything that fails keeps the built-in grammar.
+void LoadStartupGrammar(int argc, char** argv) {
+    string path;
+    for (int i = 1; i + 1 < argc; i++) if (string(argv[i]) == "--grammar") path = argv[i + 1];
+    if (path.empty()) { path = "matrix.grammar"; if (!ifstream(path)) return; }
+    string error; bool cached = false;
+    if (!LoadGrammarFile(path, loadedGrammar, error, cached)) { cerr << "grammar: " << error << " (using the built-in grammar)\n"; return; }
+    activeGrammar = &loadedGrammar;
+    cerr << "grammar: " << path << ", " << loadedGrammar.numSymbols - NUM_TERMINALS << " nonterminals, " << loadedGrammar.numRules
+         << " rules (" << (cached ? "cached" : "compiled") << ")\n";
+    if (!BuiltinRules(activeGrammar)) cerr << "grammar: " << CustomGrammarNote << "\n";
+}
+
+// --isa <scalar|sse2|avx2|avx512> caps the element-wise kernels, else the best the CPU supports.
+// --threads N sizes the multiply's pool, else one thread per core.
+// --strassen <off|exact|always>[:cutover] sets when Strassen-Winograd is used; exact by default.
+// --sparse <ratio|off> sets the share of zeros from which operands go to CSR.
+void ConfigureEvaluator(int argc, char** argv) {
+    gemmThreads = max(1, (int)thread::hardware_concurrency());
+    for (int i = 1; i + 1 < argc; i++) if (string(argv[i]) == "--threads") gemmThreads = max(1, atoi(argv[i + 1]));
+    gemmPool.resize(gemmThreads);
+    evaluator.pool = &gemmPool;
+    SimdIsa limit = (SimdIsa)(NUM_ISAS - 1);
+    for (int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) != "--isa") continue;
+        int k = 0; while (k < NUM_ISAS && argv[i + 1] != string(IsaNames[k])) k++;
+        if (k == NUM_ISAS) { cerr << "isa: unknown " << argv[i + 1] << " (scalar, sse2, avx2, avx512)\n"; continue; }
+        limit = (SimdIsa)k;
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) != "--strassen") continue;
+        string v = argv[i + 1];
+        size_t colon = v.find(':');
+        int k = 0; while (k < NUM_STRASSEN_MODES && v.compare(0, colon, StrassenModeNames[k]) != 0) k++;
+        if (k == NUM_STRASSEN_MODES) cerr << "strassen: unknown mode " << v.substr(0, colon) << " (off, exact, always)\n";
+        else evaluator.strassen = (StrassenMode)k;
+        if (colon != string::npos) evaluator.strassenCutover = max(1, atoi(v.c_str() + colon + 1));
+    }
+    for (int i = 1; i + 1 < argc; i++)
+        if (string(argv[i]) == "--sparse") evaluator.sparseZeroRatio = string(argv[i + 1]) == "off" ? 2.0 : atof(argv[i + 1]);
+    elementKernels.streamBytes = LastLevelCacheBytes();
+    elementKernels.select(limit);
+    if (elementKernels.isa != limit && limit != NUM_ISAS - 1) cerr << "isa: " << IsaNames[limit] << " not supported, using " << IsaNames[elementKernels.isa] << "\n";
+}
+
+// Returns the process exit code, or -1 when no batch mode was requested and the GUI should start.
+int RunCommandLine(int argc, char** argv) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) != "--trace") continue;
+        string v = argv[i + 1];
+        size_t colon = v.find(':');
+        for (int l = 0; l < 4; l++) if (v.compare(0, colon, TraceLevelNames[l]) == 0) batchTrace.level = (TraceLevel)l;
+        if (colon != string::npos) batchTrace.sampleEvery = max(1, atoi(v.c_str() + colon + 1));
+    }
+    for (int i = 1; i < argc; i++) {
+        string a = argv[i];
+        if (a == "--bench") return RunParserBenchmark();
+        if (a == "--bench-eval") return RunEvalBenchmark();
+        if (a == "--diff") return RunDifferential(i + 1 < argc ? atoi(argv[i + 1]) : 100000);
+        if (a == "--validate" && i + 1 < argc) return RunValidateFile(argv[i + 1]);
+        if (a == "--record" && i + 2 < argc) return RunRecordTrace(argv[i + 1], argv[i + 2]);
+        if (a == "--replay" && i + 1 < argc) return RunReplayTrace(argv[i + 1], i + 2 < argc ? atoll(argv[i + 2]) : 0, i + 3 < argc ? atoll(argv[i + 3]) : 20);
+        if (a == "--expr" && i + 1 < argc) {
+            ExprParser ep;
+            if (!ep.parse(argv[i + 1]) && ep.errorOffset < 0) { cout << ep.message << "\n"; return 1; }   // off under a loaded grammar
+            if (ep.root < 0) { cout << "REJECTED @" << ep.errorOffset << " " << ErrorKindName(ep.errorKind) << ": " << ep.message << "\n"; return 1; }
+            cout << ep.describe(ep.root) << "\n";
+            MatrixEvaluator ev; ev.pool = &gemmPool; Matrix v;
+            ev.strassen = evaluator.strassen; ev.strassenCutover = evaluator.strassenCutover; ev.sparseZeroRatio = evaluator.sparseZeroRatio;
+            ev.evaluate(ep.nodes, ep.root, v);
+            for (const LogEntry& e : ev.plan) cout << e.action << ": " << e.stackState << "\n";
+            cout << "= " << v.rows << "x" << v.cols << " (largest fused pass " << ev.fusedOperands << " operands, " << ev.temporaries << " temporaries";
+            if (ev.strassenLevels) cout << ", Strassen-Winograd " << ev.strassenLevels << " levels";
+            if (ev.sparseOperands) cout << ", " << ev.sparseOperands << " in CSR";
+            cout << ")\n";
+            for (int r = 0; r < min(v.rows, 8); r++) {
+                for (int c = 0; c < min(v.cols, 8); c++) cout << (c ? " " : "  ") << v.data[(size_t)r * v.cols + c];
+                cout << (v.cols > 8 ? " ...\n" : "\n");
+            }
+            if (v.rows > 8) cout << "  ...\n";
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// "Reset / Load". With recording on, the selected engine's run streams to tracePath as it is
+// produced; a run restored from the cache is written out whole.
+void LoadInput() {
+    traceRecorder.close(); engine.sink = lalrEngine.sink = NULL;   // an unfinished recording keeps what it has
+    if (recordTrace) {
+        traceView.close(); showTraceFile = false;   // never rewrite a file that is mapped
+        if (!traceRecorder.open(tracePath)) traceFileStatus = string("cannot write ") + tracePath;
+    }
+    TraceWriter* rec = traceRecorder.isOpen() ? &traceRecorder : NULL;
+    evaluation.ready = false; evaluation.plan.clear();
+    if (activeEngine == 0) engine.sink = rec; else lalrEngine.sink = rec;
+    bool restored[2] = {pdaRuns.load(engine, inputBuffer), lalrRuns.load(lalrEngine, inputBuffer)};
+    exprParser.parse(inputBuffer);
+    if (exprParser.root >= 0 && (strpbrk(inputBuffer, "()") || exprParser.nodes.size() > 3)) EvaluateExpressionTree();
+    if (rec && restored[activeEngine]) for (const LogEntry& e : activeEngine == 0 ? engine.history : lalrEngine.history) rec->write(e);
+    AfterStep(engine, pdaRuns); AfterStep(lalrEngine, lalrRuns);
+}
+
+int main(int argc, char** argv) {
+    LoadStartupGrammar(argc, argv);
+    ConfigureEvaluator(argc, argv);
+    int cliResult = RunCommandLine(argc, argv);
+    if (cliResult >= 0) return cliResult;
     if (!glfwInit()) return 1;
     GLFWwindow* window = glfwCreateWindow(1200, 900, "Full Compiler Sequence Visualizer", NULL, NULL);
     if (window == NULL) return 1;
@@ -382,25 +3843,39 @@ int main(int, char**) {
     ImGui::StyleColorsLight(); 
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 130");
-    engine.reset("[10,20]+[30,40]"); 
+    engine.grammar = lalrEngine.grammar = activeGrammar;
+    engine.earlyShapeCheck = false; // let the PDA animation walk the shape checks itself
+    engine.reset("[10,20]+[30,40]"); lalrEngine.reset(inputBuffer); exprParser.parse(inputBuffer);
+    liveValidator.start();
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents(); ImGui_ImplOpenGL3_NewFrame(); ImGui_ImplGlfw_NewFrame(); ImGui::NewFrame();
         ImGui::SetNextWindowPos(ImVec2(0, 0)); ImGui::SetNextWindowSize(ImVec2(1200, 80));
         ImGui::Begin("Controls", NULL, ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoTitleBar);
-        ImGui::Text("Expression:"); ImGui::SameLine(); ImGui::InputText("##Input", inputBuffer, 256); ImGui::SameLine();
-        if (ImGui::Button("Reset / Load")) engine.reset(inputBuffer); ImGui::SameLine();
-        bool disabled = engine.isLocked; if (disabled) ImGui::BeginDisabled();
-        if (ImGui::Button("STEP >>", ImVec2(150, 40))) engine.step();
-        if (disabled) ImGui::EndDisabled();
-        if (engine.isFinished) ImGui::TextColored(ImVec4(0,0.8f,0,1), "RESULT: %s", engine.statusMessage.c_str());
-        if (engine.isLocked && !engine.isFinished) ImGui::TextColored(ImVec4(1,0,0,1), "RESULT: %s", engine.statusMessage.c_str());
+        ImGui::Text("Expression:"); ImGui::SameLine(); ImGui::InputText("##Input", inputBuffer, 256);
+        ImVec2 inputMin = ImGui::GetItemRectMin(), inputMax = ImGui::GetItemRectMax(); liveValidator.submit(inputBuffer); ImGui::SameLine();
+        if (ImGui::Button("Reset / Load")) LoadInput();
+        if (ImGui::IsItemHovered()) ImGui::SetTooltip("Inputs already run to the end are restored from the run cache (%zu PDA, %zu LALR runs)", pdaRuns.size(), lalrRuns.size());
+        ImGui::SameLine();
+        if (activeEngine == 0) RenderStepControls(engine, pdaRuns); else RenderStepControls(lalrEngine, lalrRuns);
+        ImGui::SameLine(); ImGui::RadioButton("LL(1) PDA", &activeEngine, 0); ImGui::SameLine(); ImGui::RadioButton("LALR(1)", &activeEngine, 1);
+        bool builtin = BuiltinRules(activeGrammar);
+        if (activeEngine == 0) {
+            ImGui::SameLine(); ImGui::Checkbox("Report all errors", &engine.recoverErrors); ImGui::SameLine();
+            if (!builtin) ImGui::BeginDisabled();
+            ImGui::Checkbox("Early shape check", &engine.earlyShapeCheck);
+            if (!builtin) ImGui::EndDisabled();
+        }
+        if (!builtin) { ImGui::SameLine(); ImGui::TextDisabled("(?)"); if (ImGui::IsItemHovered()) ImGui::SetTooltip("Grammar file: %s", CustomGrammarNote); }
+        RenderLiveStatus(inputMin, inputMax); ImGui::SameLine(0, 40);
+        if (activeEngine == 0) RenderResult(engine); else RenderResult(lalrEngine);
         ImGui::End();
-        ImGui::SetNextWindowPos(ImVec2(0, 80)); ImGui::SetNextWindowSize(ImVec2(600, 400)); RenderNFA();
-        ImGui::SetNextWindowPos(ImVec2(600, 80)); ImGui::SetNextWindowSize(ImVec2(600, 400)); RenderPDA();
-        ImGui::SetNextWindowPos(ImVec2(0, 480)); ImGui::SetNextWindowSize(ImVec2(1200, 420)); RenderTrace();
+        if (activeEngine == 0) RenderEngineWindows(engine); else RenderEngineWindows(lalrEngine);
+        ImGui::SetNextWindowPos(ImVec2(800, 480)); ImGui::SetNextWindowSize(ImVec2(400, 210)); RenderExprTree();
+        ImGui::SetNextWindowPos(ImVec2(800, 690)); ImGui::SetNextWindowSize(ImVec2(400, 210)); RenderEvaluation();
         ImGui::Render();
         int dw, dh; glfwGetFramebufferSize(window, &dw, &dh); glViewport(0, 0, dw, dh); glClearColor(0.9f, 0.9f, 0.95f, 1.0f); glClear(GL_COLOR_BUFFER_BIT); ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData()); glfwSwapBuffers(window);
     }
+    liveValidator.stop();
     ImGui_ImplOpenGL3_Shutdown(); ImGui_ImplGlfw_Shutdown(); ImGui::DestroyContext(); glfwDestroyWindow(window); glfwTerminate();
     return 0;
 }
\ No newline at end of file
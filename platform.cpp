@@ -0,0 +1,68 @@
+#include "platform.h"
+#include <algorithm>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// The view keeps the mapping alive, so both handles are closed straight away on Windows.
+const char* MapFile(const string& path, size_t& length) {
+    length = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || !(mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL))) {
+        CloseHandle(file); return NULL;
+    }
+    const char* base = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); CloseHandle(file);
+    if (base) length = (size_t)size.QuadPart;
+    return base;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return NULL; }
+    void* m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) return NULL;
+    length = (size_t)st.st_size;
+    return (const char*)m;
+#endif
+}
+
+void UnmapFile(const char* base, size_t length) {
+    if (!base) return;
+#ifdef _WIN32
+    (void)length; UnmapViewOfFile(base);
+#else
+    munmap((void*)base, length);
+#endif
+}
+
+size_t LargestCacheBytes() {
+    size_t best = 0;
+#ifdef _WIN32
+    DWORD len = 0;
+    GetLogicalProcessorInformation(NULL, &len);
+    vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(len / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!info.empty() && GetLogicalProcessorInformation(info.data(), &len))
+        for (const auto& i : info) if (i.Relationship == RelationCache) best = max(best, (size_t)i.Cache.Size);
+#else
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    for (int name : {_SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE, _SC_LEVEL4_CACHE_SIZE}) { long v = sysconf(name); if (v > 0) best = max(best, (size_t)v); }
+#endif
+#endif
+    return best;
+}
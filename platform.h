@@ -0,0 +1,12 @@
+// OS calls main.cpp needs, kept in their own translation unit so main.cpp never includes
+// <windows.h> (whose names, like the TokenType enumerator in winnt.h, collide with ours).
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Maps a whole file read-only. NULL for a missing or empty file; `length` gets its size.
+const char* MapFile(const std::string& path, size_t& length);
+void UnmapFile(const char* base, size_t length);
+
+// Size of the largest data cache, or 0 when the OS does not say.
+size_t LargestCacheBytes();